@@ -0,0 +1,7 @@
+(defun ack (m n)
+    (if (= m 0)
+        (+ n 1)
+        (if (= n 0)
+            (ack (- m 1) 1)
+            (ack (- m 1) (ack m (- n 1))))))
+(print (ack 2 400) (ack 3 5) "\n")
@@ -0,0 +1,399 @@
+// Runs the Lisp benchmarks of this directory with the interpreter and reports,
+// as JSON on the standard output, the median and standard deviation of their
+// wall time, their allocations and their peak RSS.
+//
+// With a reference interpreter, such as a build of the previous commit, each
+// run of a benchmark is paired with a run of the reference, so that both see
+// the same machine in the same state, and a benchmark fails when the median
+// of the ratios of the pairs regressed past the threshold. With a baseline, a
+// previous report saved on the same machine, it fails when its median did.
+// Either way, a regression must also be larger than three standard errors of
+// the comparison, so that a noisy benchmark does not fail on noise alone.
+//
+//   ./bench/bench.exe [options] [NAME...]
+//     --clisp PATH      interpreter to run (./clisp.exe)
+//     --dir DIR         where the benchmarks are (bench)
+//     --runs N          measured runs of each benchmark (11)
+//     --warmup N        runs before measuring (1)
+//     --reference PATH  interpreter to compare with, run in turn with PATH
+//     --baseline FILE   report to compare with, failing when missing
+//     --threshold PCT   regression allowed over the reference (10)
+//     --save FILE       also writes the report to FILE
+
+#define _GNU_SOURCE // wait4
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_RUNS_MAX 100
+// size of the file generated for the reader benchmark
+#define BENCH_READER_SIZE (8 * 1024 * 1024)
+
+struct s_bench {
+  const char *name;
+  // script in the benchmark directory, NULL for a generated one
+  const char *file;
+  const char *description;
+};
+
+static const struct s_bench benches[] = {
+    {"fib", "fib.lisp", "doubly recursive calls"},
+    {"tak", "tak.lisp", "deep non-tail recursion, three arguments"},
+    {"ackermann", "ackermann.lisp", "very deep recursion, mostly tail calls"},
+    {"list", "list.lisp", "building and releasing lists through the reader"},
+    {"let", "let.lisp", "nested let frames"},
+    {"symbols", "symbols.lisp", "lookups of many global names"},
+    {"reader", NULL, "reading a generated multi-megabyte script"},
+    {NULL, NULL, NULL},
+};
+
+struct s_result {
+  double median;
+  double stddev;
+  size_t allocs;
+  long rss;
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1e3 + ts.tv_nsec / 1e6);
+}
+
+// Sum of the allocations reported by --memory-stats, on `fd`.
+static size_t read_allocs(int fd) {
+  FILE *fp = fdopen(fd, "r");
+  if (fp == NULL)
+    return (0);
+
+  char line[256];
+  size_t total = 0;
+  bool table = false;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (strncmp(line, "kind ", 5) == 0) {
+      table = true;
+      continue;
+    }
+    if (strncmp(line, "refs ", 5) == 0)
+      table = false;
+    char kind[32];
+    size_t allocs = 0;
+    if (table && sscanf(line, "%31s %zu", kind, &allocs) == 2)
+      total += allocs;
+  }
+  fclose(fp);
+  return (total);
+}
+
+// Runs the interpreter on `script` once: returns its wall time in ms, or a
+// negative value when it failed.
+static double run(const char *clisp, const char *script, size_t *allocs,
+                  long *rss) {
+  int pipes[2];
+  if (pipe(pipes) < 0)
+    return (-1);
+
+  double start = now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(pipes[1], STDERR_FILENO);
+    close(pipes[0]);
+    execl(clisp, clisp, "--memory-stats", script, (char *)NULL);
+    _exit(127);
+  }
+  close(pipes[1]);
+  if (pid < 0) {
+    close(pipes[0]);
+    return (-1);
+  }
+
+  *allocs = read_allocs(pipes[0]);
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0)
+    return (-1);
+  double elapsed = now() - start;
+  *rss = usage.ru_maxrss;
+  return (WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1);
+}
+
+static int compare(const void *l, const void *r) {
+  double a = *(const double *)l, b = *(const double *)r;
+  return (a > b) - (a < b);
+}
+
+// Median and standard deviation of `count` samples, sorted in place.
+static void summarize(double *samples, size_t count, double *median,
+                      double *stddev) {
+  qsort(samples, count, sizeof(*samples), compare);
+  *median = count % 2 != 0
+                ? samples[count / 2]
+                : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+  double mean = 0, variance = 0;
+  for (size_t i = 0; i < count; i++)
+    mean += samples[i] / count;
+  for (size_t i = 0; i < count; i++)
+    variance += (samples[i] - mean) * (samples[i] - mean) / count;
+  *stddev = sqrt(variance);
+}
+
+// Runs `script` with `clisp`, and before each run with `reference` when there
+// is one: `ratios` then gets the ratio of the times of each pair.
+static bool measure(const char *clisp, const char *reference,
+                    const char *script, size_t warmup, size_t runs,
+                    struct s_result *result, struct s_result *before,
+                    struct s_result *ratios) {
+  double times[BENCH_RUNS_MAX], others[BENCH_RUNS_MAX], pairs[BENCH_RUNS_MAX];
+
+  for (size_t i = 0; i < warmup + runs; i++) {
+    double other = 1;
+    if (reference != NULL &&
+        (other = run(reference, script, &before->allocs, &before->rss)) < 0)
+      return (false);
+    double elapsed = run(clisp, script, &result->allocs, &result->rss);
+    if (elapsed < 0)
+      return (false);
+    if (i < warmup)
+      continue;
+    times[i - warmup] = elapsed;
+    others[i - warmup] = other;
+    pairs[i - warmup] = elapsed / other;
+  }
+
+  summarize(times, runs, &result->median, &result->stddev);
+  if (reference != NULL) {
+    summarize(others, runs, &before->median, &before->stddev);
+    summarize(pairs, runs, &ratios->median, &ratios->stddev);
+  }
+  return (true);
+}
+
+// Standard error of the median of `runs` samples of deviation `stddev`.
+static double median_error(double stddev, size_t runs) {
+  return (1.2533 * stddev / sqrt(runs));
+}
+
+// Largest value `measured` may take over `expected` without regressing: past
+// the threshold, and past three standard errors of their difference.
+static double allowed(double expected, double threshold, double error) {
+  double limit = expected * (1 + threshold / 100);
+  return (limit > expected + 3 * error ? limit : expected + 3 * error);
+}
+
+// A script of quoted forms of every kind, about BENCH_READER_SIZE bytes.
+static bool generate(char *path) {
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return (false);
+  FILE *fp = fdopen(fd, "w");
+  if (fp == NULL)
+    return (false);
+
+  long size = 0;
+  for (int i = 0; size < BENCH_READER_SIZE; i++) {
+    int n = fprintf(fp,
+                    "'(define symbol-%d (lambda (x y) (+ x %d (* y -%d))) "
+                    "\"string %d with \\\"escapes\\\"\" (nested (list %d)))\n",
+                    i % 1000, i, i % 97, i, i);
+    if (n < 0)
+      break;
+    size += n;
+  }
+  return (fclose(fp) == 0 && size >= BENCH_READER_SIZE);
+}
+
+// `field` of the entry of `name` in the report `text`, or of the report
+// itself when `name` is NULL; a negative value when it is missing.
+static double baseline_field(const char *text, const char *name,
+                             const char *field) {
+  char key[128];
+  snprintf(key, sizeof(key), "\"name\": \"%s\"", name != NULL ? name : "");
+  const char *p = text;
+  if (p != NULL && name != NULL)
+    p = strstr(p, key);
+  snprintf(key, sizeof(key), "\"%s\":", field);
+  if (p == NULL || (p = strstr(p, key)) == NULL)
+    return (-1);
+  return (strtod(p + strlen(key), NULL));
+}
+
+static char *slurp(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL)
+    return (NULL);
+  char *text = NULL;
+  size_t size = 0;
+  FILE *out = open_memstream(&text, &size);
+  char buffer[4096];
+  for (size_t n; (n = fread(buffer, 1, sizeof(buffer), fp)) > 0;)
+    fwrite(buffer, 1, n, out);
+  fclose(out);
+  fclose(fp);
+  return (text);
+}
+
+static bool selected(const char *name, int argc, const char **argv) {
+  if (argc == 0)
+    return (true);
+  for (int i = 0; i < argc; i++)
+    if (strcmp(argv[i], name) == 0)
+      return (true);
+  return (false);
+}
+
+int main(int argc, const char *argv[]) {
+  const char *clisp = "./clisp.exe";
+  const char *dir = "bench";
+  const char *reference = NULL;
+  const char *baseline = NULL;
+  const char *save = NULL;
+  size_t runs = 11, warmup = 1;
+  double threshold = 10;
+
+  int offset = 1;
+  for (; offset + 1 < argc && strncmp(argv[offset], "--", 2) == 0;
+       offset += 2) {
+    const char *option = argv[offset], *value = argv[offset + 1];
+    if (strcmp(option, "--clisp") == 0)
+      clisp = value;
+    else if (strcmp(option, "--dir") == 0)
+      dir = value;
+    else if (strcmp(option, "--runs") == 0)
+      runs = strtoul(value, NULL, 10);
+    else if (strcmp(option, "--warmup") == 0)
+      warmup = strtoul(value, NULL, 10);
+    else if (strcmp(option, "--reference") == 0)
+      reference = value;
+    else if (strcmp(option, "--baseline") == 0)
+      baseline = value;
+    else if (strcmp(option, "--threshold") == 0)
+      threshold = strtod(value, NULL);
+    else if (strcmp(option, "--save") == 0)
+      save = value;
+    else
+      break;
+  }
+  if (runs == 0 || runs > BENCH_RUNS_MAX ||
+      (reference != NULL && baseline != NULL) ||
+      (offset < argc && strncmp(argv[offset], "--", 2) == 0)) {
+    fprintf(stderr, "usage: %s [--clisp PATH] [--dir DIR] [--runs N] "
+                    "[--warmup N] [--reference PATH | --baseline FILE] "
+                    "[--threshold PCT] "
+                    "[--save FILE] [NAME...]\n",
+            argv[0]);
+    return (2);
+  }
+
+  char *saved = baseline != NULL ? slurp(baseline) : NULL;
+  if (baseline != NULL && saved == NULL) {
+    fprintf(stderr, "no baseline at %s, run make bench-save first\n",
+            baseline);
+    return (1);
+  }
+  double saved_runs = baseline_field(saved, NULL, "runs");
+
+  char generated[] = "/tmp/clisp-bench-XXXXXX";
+  bool regressed = false, failed = false;
+  char *report = NULL;
+  size_t size = 0;
+  FILE *out = open_memstream(&report, &size);
+  fprintf(out, "{\n  \"runs\": %zu,\n  \"warmup\": %zu,\n  \"benchmarks\": [",
+          runs, warmup);
+
+  const char *separator = "\n";
+  for (const struct s_bench *bench = benches; bench->name != NULL; bench++) {
+    if (!selected(bench->name, argc - offset, argv + offset))
+      continue;
+
+    char script[4096];
+    if (bench->file != NULL) {
+      snprintf(script, sizeof(script), "%s/%s", dir, bench->file);
+    } else {
+      if (generated[sizeof(generated) - 2] == 'X' && !generate(generated)) {
+        fprintf(stderr, "%s: cannot generate its input\n", bench->name);
+        failed = true;
+        continue;
+      }
+      snprintf(script, sizeof(script), "%s", generated);
+    }
+
+    fprintf(stderr, "%-10s %s\n", bench->name, bench->description);
+    struct s_result result = {0}, before = {0}, ratios = {0};
+    if (!measure(clisp, reference, script, warmup, runs, &result, &before,
+                 &ratios)) {
+      fprintf(stderr, "%s: failed to run %s\n", bench->name, script);
+      failed = true;
+      continue;
+    }
+
+    fprintf(out,
+            "%s    {\"name\": \"%s\", \"median_ms\": %.3f, "
+            "\"stddev_ms\": %.3f, \"allocs\": %zu, \"peak_rss_kb\": %ld",
+            separator, bench->name, result.median, result.stddev,
+            result.allocs, result.rss);
+    if (reference != NULL)
+      fprintf(out,
+              ", \"reference_median_ms\": %.3f, \"reference_allocs\": %zu, "
+              "\"ratio\": %.3f, \"ratio_stddev\": %.3f",
+              before.median, before.allocs, ratios.median, ratios.stddev);
+    fprintf(out, "}");
+    separator = ",\n";
+
+    // the ratios of the pairs are compared with 1, the medians of a saved
+    // baseline with each other
+    double measured = ratios.median, expected = 1, limit = 0;
+    if (reference != NULL) {
+      limit = allowed(1, threshold, median_error(ratios.stddev, runs));
+    } else if (saved != NULL) {
+      expected = baseline_field(saved, bench->name, "median_ms");
+      double stddev = baseline_field(saved, bench->name, "stddev_ms");
+      if (expected <= 0 || stddev < 0 || saved_runs <= 0) {
+        fprintf(stderr, "%s: not in the baseline, not compared\n",
+                bench->name);
+        continue;
+      }
+      double error = hypot(median_error(result.stddev, runs),
+                           median_error(stddev, saved_runs));
+      measured = result.median;
+      limit = allowed(expected, threshold, error);
+    } else {
+      continue;
+    }
+    if (measured > limit) {
+      fprintf(stderr,
+              "REGRESSION %s: +%.1f%% over the %s, allowed +%.1f%%\n",
+              bench->name, 100 * (measured / expected - 1),
+              reference != NULL ? "reference" : "baseline",
+              100 * (limit / expected - 1));
+      regressed = true;
+    }
+  }
+  fprintf(out, "\n  ]\n}\n");
+  fclose(out);
+
+  if (generated[sizeof(generated) - 2] != 'X')
+    unlink(generated);
+
+  fputs(report, stdout);
+  if (save != NULL) {
+    FILE *fp = fopen(save, "w");
+    if (fp == NULL || fputs(report, fp) < 0 || fclose(fp) != 0) {
+      perror(save);
+      failed = true;
+    }
+  }
+
+  free(report);
+  free(saved);
+  return (failed || regressed ? 1 : 0);
+}
@@ -0,0 +1,12 @@
+(defun nest (n)
+    (let (a n)
+        (let (b (+ a 1))
+            (let (c (+ b 1))
+                (let (d (+ c 1))
+                    (let (e (+ d 1))
+                        (let (f (+ e 1))
+                            (let (g (+ f 1))
+                                (let (h (+ g 1))
+                                    (+ a b c d e f g h))))))))))
+(defun run (n acc) (if (= n 0) acc (run (- n 1) (+ acc (- (nest n) (* 8 n))))))
+(print (run 30000 0) "\n")
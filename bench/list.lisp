@@ -0,0 +1,6 @@
+(define text "(a b c d e f g h i j (k l m n o p) (q r s t u v) w x y z 1 2 3 4 5 6 7 8 9 10 \"s\" \"t\")")
+(defun build (n acc)
+    (if (= n 0)
+        acc
+        (build (- n 1) (do (read text) (+ acc 1)))))
+(print (build 30000 0) "\n")
@@ -1,55 +1,182 @@
+#include "object_fasl.h"
 #include "object_parse.h"
+#include "pipeline.h"
+#include "profile.h"
+#include "server.h"
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
+// Next top-level form: from the cache when it was loaded, otherwise parsed,
+// ahead by the reader thread of a pipeline if there is one, and recorded for
+// the cache to be written when there is a writer.
+static object_t next_form(stream_t s, struct s_pipeline *pipeline,
+                          struct s_fasl_reader *reader,
+                          struct s_fasl_writer *writer) {
+  if (reader != NULL)
+    return object_fasl_read(reader);
+
+  object_t form = pipeline != NULL ? pipeline_next(pipeline) : object_parse(s);
+  if (form != NULL && writer != NULL)
+    object_fasl_write(writer, form);
+  return (form);
+}
+
 int main(int argc, const char *argv[]) {
   const char *prompt = NULL;
+  const char *path = NULL;
   FILE *fp = NULL;
+  bool cache = false;
+  bool pipelined = false;
+  const char *dump_image = NULL;
+  const char *image = NULL;
+  const char *server = NULL;
+  const char *profile = NULL;
+  bool memory_stats = false;
+  size_t budget = 0;
+  size_t workers = 4;
+  int status = 0;
   int offset = 1;
 
-  if (argc > 1) {
-    if (strcmp(argv[1], "--") != 0) {
-      fp = fopen(argv[1], "r");
+  for (; offset < argc && strncmp(argv[offset], "--", 2) == 0 &&
+         argv[offset][2] != 0;
+       offset++) {
+    if (strcmp(argv[offset], "--tree-walk") == 0) {
+      object_use_tree_walk(true);
+    } else if (strcmp(argv[offset], "--cache") == 0) {
+      cache = true;
+    } else if (strcmp(argv[offset], "--pipeline") == 0) {
+      pipelined = true;
+    } else if (strcmp(argv[offset], "--dump-image") == 0 && offset + 1 < argc) {
+      dump_image = argv[++offset];
+    } else if (strcmp(argv[offset], "--image") == 0 && offset + 1 < argc) {
+      image = argv[++offset];
+    } else if (strcmp(argv[offset], "--free-budget") == 0 &&
+               offset + 1 < argc) {
+      budget = strtoul(argv[++offset], NULL, 10);
+      memory_set_budget(budget);
+    } else if (strcmp(argv[offset], "--memory-stats") == 0) {
+      memory_stats = true;
+    } else if (strcmp(argv[offset], "--profile") == 0 && offset + 1 < argc) {
+      profile = argv[++offset];
+    } else if (strcmp(argv[offset], "--server") == 0 && offset + 1 < argc) {
+      server = argv[++offset];
+    } else if (strcmp(argv[offset], "--workers") == 0 && offset + 1 < argc) {
+      workers = strtoul(argv[++offset], NULL, 10);
+    } else {
+      printf("ERROR: unknown option '%s'\n", argv[offset]);
+      return (1);
+    }
+  }
+
+  if (argc > offset) {
+    if (strcmp(argv[offset], "--") != 0) {
+      path = argv[offset];
+      fp = fopen(path, "r");
       assert(fp != NULL);
     } else {
       fp = stdin;
       prompt = "minilisp> ";
     }
     offset += 1;
-  } else {
+  } else if (server == NULL) {
     fp = stdin;
     prompt = "minilisp> ";
   }
 
-  stream_new(s, stream_create_from_file(fp), {
-    object_new(env, object_create_env(argc - offset, argv + offset), {
-      bool running = true;
-      while (running) {
-        running = false;
-        printf("%s", prompt ? prompt : "");
-        object_new(object, object_parse(s), {
-          running = true;
-          // object_print(object);
-          object_new(result, object_eval(env, object), {
+  // the global frame starts from an image written by --dump-image, which
+  // holds the definitions of the script that was run to write it; it is
+  // loaded before the cache, whose symbols are then those of the image
+  object_t global = NULL;
+  if (image != NULL) {
+    global = object_load_image(image, argc - offset, argv + offset);
+    if (global == NULL) {
+      printf("ERROR: cannot load image '%s'\n", image);
+      return (1);
+    }
+  } else {
+    global = object_create_env(argc - offset, argv + offset);
+  }
+
+  // a script run with --cache is loaded from `<script>.fasl` while its content
+  // does not change, otherwise its forms are recorded to write that file
+  char *fasl = NULL;
+  struct s_fasl_source source;
+  struct s_fasl_reader *reader = NULL;
+  struct s_fasl_writer *writer = NULL;
+  if (cache && path != NULL) {
+    fasl = malloc(strlen(path) + sizeof(".fasl"));
+    assert(fasl != NULL);
+    sprintf(fasl, "%s.fasl", path);
+    object_fasl_source(fileno(fp), &source);
+    reader = object_fasl_load(fasl, &source);
+    if (reader == NULL)
+      writer = object_fasl_create();
+  }
+
+  // samples every millisecond of CPU time
+  if (profile != NULL && !profile_start(profile, 1000)) {
+    printf("ERROR: cannot start the profiler\n");
+    return (1);
+  }
+
+  object_new(env, global, {
+    // a server runs its script first, as a prelude shared by its workers
+    if (fp != NULL) {
+      stream_new(s, stream_create_from_file(fp), {
+        // the REPL keeps parsing a form after each prompt
+        struct s_pipeline *pipeline = NULL;
+        if (pipelined && prompt == NULL && reader == NULL)
+          pipeline = pipeline_start(s);
+        bool running = true;
+        while (running) {
+          running = false;
+          printf("%s", prompt ? prompt : "");
+          object_new(object, next_form(s, pipeline, reader, writer), {
+            running = true;
+            // object_print(object);
+            object_new(result, object_run(env, object), {
 #ifdef NDEBUG
-            if (prompt != NULL)
+              if (prompt != NULL)
 #endif
-            {
-              object_print(result);
-              printf("\n");
-            }
+              {
+                object_print(result);
+                printf("\n");
+              }
+            });
           });
-        });
-      }
-    });
+          // the garbage of a form is freed by the next ones, a bit per step
+          if (budget != 0)
+            memory_drain(budget);
+        }
+        if (pipeline != NULL)
+          pipeline_stop(pipeline);
+      });
+    }
+    if (dump_image != NULL && !object_dump_image(env, dump_image))
+      printf("ERROR: cannot write image '%s'\n", dump_image);
+    if (server != NULL)
+      status = server_run(env, server, workers);
   });
 
-  if (prompt == NULL) {
-    assert(fp != NULL);
+  profile_stop();
+  // the global frame and its functions reference each other
+  memory_collect();
+  memory_drain(SIZE_MAX);
+  if (memory_stats)
+    object_dump_memory_stats(stderr);
+
+  if (writer != NULL)
+    object_fasl_save(writer, fasl, &source);
+  if (reader != NULL)
+    object_fasl_close(reader);
+  free(fasl);
+
+  if (prompt == NULL && fp != NULL) {
     fclose(fp);
     fp = NULL;
   }
 
-  return (0);
+  return (status);
 }
\ No newline at end of file
@@ -2,63 +2,573 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+// Small blocks are served from per-size-class pools. Build with
+// -DMEMORY_USE_MALLOC (implied by -fsanitize=address) to get one malloc per
+// block instead, so that sanitizers see every allocation, and with
+// -DMEMORY_DEBUG to fill freed blocks with garbage. Builds with assertions
+// also keep an alive bit in every block, to catch the uses of dead blocks.
+#if defined(MEMORY_USE_MALLOC) || defined(__SANITIZE_ADDRESS__)
+#define MEMORY_POOLS 0
+#else
+#define MEMORY_POOLS 32
+#endif
+#define MEMORY_GRANULE 8
+// chunks are aligned on their size, so that a block finds its chunk
+#define MEMORY_CHUNK (64 * 1024)
+// possible roots of cycles gathered before a collection runs
+#define MEMORY_ROOTS 10000
+
+// Colors of the cycle collector.
+typedef enum {
+  kMC_black, // in use, or not looked at yet
+  kMC_gray,  // member of a possible cycle
+  kMC_white, // member of a garbage cycle
+  kMC_purple, // possible root of a cycle
+  kMC_garbage, // being freed by the collector
+  kMC_freed,   // dead, its storage kept until it leaves the roots
+  kMC_pending, // dead, waiting in the pending list to be freed
+} memory_color_t;
+
+#ifndef NDEBUG
+#define MEMORY_ALIVE 1
+#else
+#define MEMORY_ALIVE 0
+#endif
+#define MEMORY_COUNT_BITS (23 - MEMORY_ALIVE)
+// A count that reaches this value never changes again: the block lives as
+// long as the process, like the blocks laid out by memory_place.
+#define MEMORY_STICKY ((1U << MEMORY_COUNT_BITS) - 1)
+
+// The header of a block is the 32-bit word right before its data: its kind,
+// which tells what to do with the block, such as running its destructor,
+// the state of the block in the cycle collector, and its count of
+// references. The size of a block follows from the pool of its chunk, or
+// precedes the header of a block malloc'ed on its own. The kind comes first,
+// for memory_kind to read it from the low bits of the word. The alive bit,
+// when compiled in, is the lowest bit of the count of the other builds: a
+// placed block, whose count and alive bit are all ones, is immortal for
+// both.
+// Retains and releases update the whole word at once, with the masks below:
+// mixing stores of a byte of the header with loads of the whole word would
+// keep the loads from being served by the stores.
 struct s_memory {
-  bool alive;
-  size_t counter;
-  void (*free)(void *ptr);
-  char data[1];
+  union {
+    struct {
+      uint32_t kind : 4;
+      uint32_t color : 3;
+      // whether the block is in the roots of the cycle collector
+      uint32_t buffered : 1;
+      // whether it was malloc'ed on its own rather than taken from a pool
+      uint32_t big : 1;
+#if MEMORY_ALIVE
+      // false once the last reference was released, even while the block
+      // waits in the pending list to be freed
+      uint32_t alive : 1;
+#endif
+      uint32_t count : MEMORY_COUNT_BITS;
+    };
+    uint32_t word;
+  };
+  char data[];
+};
+
+#define MEMORY_COLOR_SHIFT 4
+#define MEMORY_COLOR_MASK (7U << MEMORY_COLOR_SHIFT)
+#define MEMORY_BUFFERED (1U << 7)
+#define MEMORY_ALIVE_BIT (1U << 9)
+#define MEMORY_COUNT_SHIFT (32 - MEMORY_COUNT_BITS)
+#define MEMORY_ONE (1U << MEMORY_COUNT_SHIFT)
+
+_Static_assert(offsetof(struct s_memory, data) == sizeof(uint32_t),
+               "the header of a block must fit in a 32-bit word");
+_Static_assert(MEMORY_KINDS == 16, "the kind of a block must fit in 4 bits");
+
+#define get(data)                                                              \
+  ((struct s_memory *)(((char *)data) - offsetof(struct s_memory, data)))
+
+#define array_push(_array, _value)                                             \
+  do {                                                                         \
+    if ((_array).count == (_array).capacity) {                                 \
+      (_array).capacity = (_array).capacity == 0 ? 256 : (_array).capacity * 2; \
+      (_array).data =                                                          \
+          realloc((_array).data, (_array).capacity * sizeof(*(_array).data));  \
+      assert((_array).data != NULL);                                           \
+    }                                                                          \
+    (_array).data[(_array).count++] = (_value);                                \
+  } while (0)
+
+// Each pool carves blocks out of large chunks and recycles released blocks
+// through a free list threaded through their (dead) data. Pools 1 to
+// MEMORY_POOLS serve a size class each; a kind with an arena gets a pool of
+// its own after them, so that its blocks are packed together. The blocks of a
+// chunk follow the number of its pool, a word that leaves the data of the
+// first block aligned, and the sizes of the pools keep the others aligned.
+struct s_chunk {
+  uint32_t pool;
+  char blocks[];
+};
+
+#define chunk_of(_block)                                                       \
+  ((struct s_chunk *)((uintptr_t)(_block) & ~(uintptr_t)(MEMORY_CHUNK - 1)))
+
+// A block malloc'ed on its own starts this far into its allocation, after
+// its size, so that its data is aligned as well.
+#define MEMORY_PREFIX (2 * sizeof(size_t) - offsetof(struct s_memory, data))
+
+struct s_pool {
+  struct s_memory *free;
+  char *next;
+  char *end;
+  size_t size;
 };
 
-void *memory_create(size_t size, void (*free)(void *)) {
+static struct s_pool pools[MEMORY_POOLS + 1 + MEMORY_KINDS];
+// pool of the arena of each kind, 0 for none
+static uint8_t arenas[MEMORY_KINDS];
+
+static struct s_memory *pool_alloc(size_t pool) {
+  struct s_pool *self = &pools[pool];
+  size_t size = self->size;
+
+  if (self->free != NULL) {
+    struct s_memory *block = self->free;
+    self->free = *((struct s_memory **)block->data);
+    return (block);
+  }
+
+  if ((size_t)(self->end - self->next) < size) {
+    struct s_chunk *chunk = aligned_alloc(MEMORY_CHUNK, MEMORY_CHUNK);
+    assert(chunk != NULL);
+    chunk->pool = pool;
+    self->next = chunk->blocks;
+    self->end = self->next + (MEMORY_CHUNK - sizeof(*chunk)) / size * size;
+  }
+  void *block = self->next;
+  self->next += size;
+  return (block);
+}
+
+static void pool_free(size_t pool, struct s_memory *block) {
+  struct s_pool *self = &pools[pool];
+  *((struct s_memory **)block->data) = self->free;
+  self->free = block;
+}
+
+static void pool_init(size_t pool, size_t size) {
+  size = (size + MEMORY_GRANULE - 1) / MEMORY_GRANULE * MEMORY_GRANULE;
+  pools[pool].size = size;
+}
+
+__attribute__((constructor)) static void memory_init(void) {
+  for (size_t pool = 1; pool <= MEMORY_POOLS; pool++)
+    pool_init(pool, pool * MEMORY_GRANULE);
+
+  // memory_kind and the masks rely on where the compiler put the fields
+  struct s_memory header = {.kind = MEMORY_KINDS - 1};
+  assert(header.word == MEMORY_KINDS - 1);
+  header = (struct s_memory){.color = 7, .buffered = true};
+  assert(header.word == (MEMORY_COLOR_MASK | MEMORY_BUFFERED));
+  header = (struct s_memory){.count = MEMORY_STICKY};
+  assert(header.word == (uint32_t)(MEMORY_STICKY * MEMORY_ONE));
+#if MEMORY_ALIVE
+  header = (struct s_memory){.alive = true};
+  assert(header.word == MEMORY_ALIVE_BIT);
+#endif
+  ((void)header);
+}
+
+static struct s_memory_stats stats[MEMORY_KINDS];
+static void (*destructors[MEMORY_KINDS])(void *ptr);
+
+// Dead blocks not freed yet. Freeing a block releases what it references,
+// which may kill more blocks: they are queued here rather than freed
+// recursively, so that a long list is freed in constant C stack. With a
+// budget, at most that many blocks are freed per allocation, or per call to
+// memory_drain, which bounds the pauses when a large structure dies.
+static struct {
+  struct s_memory **data;
+  size_t count;
+  size_t capacity;
+} pending;
+static bool draining = false;
+static size_t budget = 0;
+
+// bytes taken by a block, header included
+static size_t block_size(struct s_memory *ptr) {
+  if (!ptr->big)
+    return (pools[chunk_of(ptr)->pool].size);
+  size_t size = 0;
+  memcpy(&size, (char *)ptr - MEMORY_PREFIX, sizeof(size));
+  return (size);
+}
+
+static void destroy(struct s_memory *ptr) {
+  struct s_memory_stats *kind_stats = &stats[ptr->kind];
+  kind_stats->frees += 1;
+  kind_stats->live -= 1;
+  kind_stats->bytes -= block_size(ptr);
+  if (destructors[ptr->kind] != NULL)
+    destructors[ptr->kind](ptr->data);
+}
+
+static void reclaim(struct s_memory *ptr) {
+#ifdef MEMORY_DEBUG
+  memset(ptr->data, 0xdb, block_size(ptr) - offsetof(struct s_memory, data));
+#endif
+  if (ptr->big)
+    free((char *)ptr - MEMORY_PREFIX);
+  else
+    pool_free(chunk_of(ptr)->pool, ptr);
+}
+
+// The roots still point at a buffered block: only the collector frees it.
+static void memory_free(struct s_memory *ptr) {
+  destroy(ptr);
+  if (ptr->buffered)
+    ptr->color = kMC_freed;
+  else
+    reclaim(ptr);
+}
+
+void memory_drain(size_t limit) {
+  if (draining)
+    return;
+  draining = true;
+  for (; pending.count > 0 && limit > 0; limit--)
+    memory_free(pending.data[--pending.count]);
+  draining = false;
+}
+
+void memory_set_budget(size_t limit) { //
+  budget = limit;
+}
+
+const struct s_memory_stats *memory_stats(unsigned kind) {
+  assert(kind < MEMORY_KINDS);
+  return (&stats[kind]);
+}
+
+// Cycles are collected by trial deletion [Bacon and Rajan, 2001]. A block of
+// a kind that can close a cycle becomes a possible root when a release leaves
+// it alive. A collection subtracts the references internal to the subgraph
+// reachable from the roots: the blocks left without references are only
+// referenced by cycles, and are freed.
+struct s_kind {
+  memory_children_t *children;
+  bool root;
+};
+
+static struct s_kind kinds[MEMORY_KINDS];
+
+static struct {
+  struct s_memory **data;
+  size_t count;
+  size_t capacity;
+} roots, stack, garbage;
+
+static struct s_memory_cycles cycles;
+
+void memory_set_children(unsigned kind, memory_children_t *children,
+                         bool root) {
+  assert(kind < MEMORY_KINDS);
+  kinds[kind].children = children;
+  kinds[kind].root = root;
+}
+
+const struct s_memory_cycles *memory_cycles(void) { //
+  return (&cycles);
+}
+
+static void children(struct s_memory *ptr, void (*visit)(void *data)) {
+  if (kinds[ptr->kind].children != NULL)
+    kinds[ptr->kind].children(ptr->data, visit);
+}
+
+// Trial deletion takes the internal references away from the counts, and
+// gives them back to the blocks found alive; sticky counts are left alone,
+// which keeps their blocks alive.
+static void visit_gray(void *data) {
+  struct s_memory *ptr = get(data);
+  if (ptr->count != MEMORY_STICKY)
+    ptr->count -= 1;
+  array_push(stack, ptr);
+}
+
+static void visit_scan(void *data) { //
+  array_push(stack, get(data));
+}
+
+static void visit_black(void *data) {
+  struct s_memory *ptr = get(data);
+  if (ptr->count != MEMORY_STICKY)
+    ptr->count += 1;
+  if (ptr->color != kMC_black) {
+    ptr->color = kMC_black;
+    array_push(stack, ptr);
+  }
+}
+
+static void visit_restore(void *data) {
+  struct s_memory *ptr = get(data);
+  if (ptr->count != MEMORY_STICKY)
+    ptr->count += 1;
+}
+
+static void mark_gray(struct s_memory *root) {
+  array_push(stack, root);
+  while (stack.count > 0) {
+    struct s_memory *ptr = stack.data[--stack.count];
+    if (ptr->color == kMC_gray)
+      continue;
+    ptr->color = kMC_gray;
+    children(ptr, visit_gray);
+  }
+}
+
+// Blocks still referenced from outside of the subgraph get their references
+// back, with all they reference; the others are garbage.
+static void scan(struct s_memory *root) {
+  array_push(stack, root);
+  while (stack.count > 0) {
+    struct s_memory *ptr = stack.data[--stack.count];
+    if (ptr->color != kMC_gray)
+      continue;
+    if (ptr->count == 0) {
+      ptr->color = kMC_white;
+      children(ptr, visit_scan);
+      continue;
+    }
+    size_t base = stack.count;
+    ptr->color = kMC_black;
+    children(ptr, visit_black);
+    while (stack.count > base) {
+      struct s_memory *black = stack.data[--stack.count];
+      children(black, visit_black);
+    }
+  }
+}
+
+static void collect_white(struct s_memory *root) {
+  array_push(stack, root);
+  while (stack.count > 0) {
+    struct s_memory *ptr = stack.data[--stack.count];
+    if (ptr->color != kMC_white)
+      continue;
+    ptr->color = kMC_garbage;
+    array_push(garbage, ptr);
+    children(ptr, visit_scan);
+  }
+}
+
+void memory_collect(void) {
+  if (draining)
+    return;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  draining = true;
+
+  // dead roots only wait to leave the roots, blocks used since being
+  // buffered are not roots anymore
+  size_t count = 0;
+  for (size_t i = 0; i < roots.count; i++) {
+    struct s_memory *ptr = roots.data[i];
+    if (ptr->color == kMC_freed) {
+      ptr->buffered = false;
+      reclaim(ptr);
+    } else if (ptr->color == kMC_pending) {
+      roots.data[count++] = ptr;
+    } else if (ptr->color == kMC_purple) {
+      mark_gray(ptr);
+      roots.data[count++] = ptr;
+    } else {
+      ptr->buffered = false;
+    }
+  }
+  roots.count = count;
+
+  for (size_t i = 0; i < roots.count; i++)
+    if (roots.data[i]->color != kMC_pending)
+      scan(roots.data[i]);
+
+  // dead roots still in the pending list stay in the roots
+  count = 0;
+  for (size_t i = 0; i < roots.count; i++) {
+    struct s_memory *ptr = roots.data[i];
+    if (ptr->color == kMC_pending) {
+      roots.data[count++] = ptr;
+      continue;
+    }
+    ptr->buffered = false;
+    collect_white(ptr);
+  }
+  roots.count = count;
+
+  // garbage releases what it references as usual, but the references
+  // between its blocks only go away with them
+  for (size_t i = 0; i < garbage.count; i++)
+    children(garbage.data[i], visit_restore);
+  for (size_t i = 0; i < garbage.count; i++)
+    destroy(garbage.data[i]);
+  for (size_t i = 0; i < garbage.count; i++)
+    reclaim(garbage.data[i]);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  size_t elapsed = (end.tv_sec - start.tv_sec) * 1000000000 +
+                   (end.tv_nsec - start.tv_nsec);
+  cycles.collections += 1;
+  cycles.collected += garbage.count;
+  cycles.nanoseconds += elapsed;
+  if (elapsed > cycles.longest)
+    cycles.longest = elapsed;
+  garbage.count = 0;
+
+  draining = false;
+  memory_drain(budget != 0 ? budget : SIZE_MAX);
+}
+
+void memory_set_arena(unsigned kind, size_t size) {
+  assert(kind < MEMORY_KINDS);
+  assert(arenas[kind] == 0);
+  if (MEMORY_POOLS == 0)
+    return;
+  arenas[kind] = MEMORY_POOLS + 1 + kind;
+  assert(size >= sizeof(struct s_memory *));
+  pool_init(arenas[kind], size + offsetof(struct s_memory, data));
+}
+
+void memory_set_destructor(unsigned kind, void (*free)(void *ptr)) {
+  assert(kind < MEMORY_KINDS);
+  destructors[kind] = free;
+}
+
+void *memory_create(size_t size) { //
+  return memory_create_kind(size, 0);
+}
+
+void *memory_create_kind(size_t size, unsigned kind) {
   struct s_memory *self = NULL;
+  size_t pool = 0;
 
-  size += sizeof(*self) - 1;
-  self = malloc(size);
+  assert(kind < MEMORY_KINDS);
+  if (pending.count > 0)
+    memory_drain(budget);
+  if (roots.count >= MEMORY_ROOTS)
+    memory_collect();
+  // a block in a free list holds the pointer to the next one
+  if (size < sizeof(struct s_memory *))
+    size = sizeof(struct s_memory *);
+  size += offsetof(struct s_memory, data);
+  if (arenas[kind] != 0 && size <= pools[arenas[kind]].size) {
+    pool = arenas[kind];
+    self = pool_alloc(pool);
+  } else if ((size + MEMORY_GRANULE - 1) / MEMORY_GRANULE <= MEMORY_POOLS) {
+    pool = (size + MEMORY_GRANULE - 1) / MEMORY_GRANULE;
+    self = pool_alloc(pool);
+  } else {
+    char *prefix = malloc(MEMORY_PREFIX + size);
+    assert(prefix != NULL);
+    *(size_t *)prefix = size;
+    self = (struct s_memory *)(prefix + MEMORY_PREFIX);
+  }
   assert(self != NULL);
   memset(self, 0, size);
 
-  self->alive = true;
-  self->free = free;
+  *self = (struct s_memory){
+      .kind = kind,
+      .big = pool == 0,
+#if MEMORY_ALIVE
+      .alive = true,
+#endif
+      .count = 1,
+  };
+
+  struct s_memory_stats *kind_stats = &stats[kind];
+  kind_stats->allocs += 1;
+  kind_stats->live += 1;
+  kind_stats->bytes += pool != 0 ? pools[pool].size : size;
+  if (kind_stats->bytes > kind_stats->peak)
+    kind_stats->peak = kind_stats->bytes;
 
   return (self->data);
 }
 
-#define get(data)                                                              \
-  ((struct s_memory *)(((char *)data) - offsetof(struct s_memory, data)))
-
-#include <stdio.h>
-
 void *memory_retain(void *data) {
   struct s_memory *ptr = get(data);
+  uint32_t word = ptr->word;
+
+#if MEMORY_ALIVE
+  assert((word & MEMORY_ALIVE_BIT) != 0);
+#endif
+  if (word < MEMORY_STICKY * MEMORY_ONE)
+    word += MEMORY_ONE;
+  // kMC_black
+  word &= ~MEMORY_COLOR_MASK;
+  ptr->word = word;
 
-  assert(ptr->alive == true);
-  ptr->counter += 1;
+  struct s_memory_stats *kind_stats = &stats[word & (MEMORY_KINDS - 1)];
+  kind_stats->retains += 1;
+  size_t bucket = 63 - __builtin_clzll(word >> MEMORY_COUNT_SHIFT);
+  kind_stats->counts[bucket < MEMORY_BUCKETS ? bucket : MEMORY_BUCKETS - 1] +=
+      1;
   return (data);
 }
 
-#include "object.h"
-
 void *memory_release(void *data) {
   struct s_memory *ptr = get(data);
-  assert(ptr->alive == true);
+  uint32_t word = ptr->word;
+  unsigned kind = word & (MEMORY_KINDS - 1);
+  unsigned color = (word & MEMORY_COLOR_MASK) >> MEMORY_COLOR_SHIFT;
+  // the collector frees the members of a garbage cycle all at once
+  if (color == kMC_garbage)
+    return (NULL);
+#if MEMORY_ALIVE
+  assert((word & MEMORY_ALIVE_BIT) != 0);
+#endif
 
-  if (ptr->counter > 100) {
-    printf("ptr->counter: %ld\n", ptr->counter);
-    assert(false);
-  }
-  if (ptr->counter > 0) {
-    ptr->counter -= 1;
+  struct s_memory_stats *kind_stats = &stats[kind];
+  kind_stats->releases += 1;
+  if (word >= MEMORY_STICKY * MEMORY_ONE)
+    return (data);
+  if (word >= 2 * MEMORY_ONE) {
+    word -= MEMORY_ONE;
+    // what is left may be referenced by a cycle only
+    if (!kinds[kind].root || color == kMC_purple) {
+      ptr->word = word;
+      return (data);
+    }
+    word = (word & ~MEMORY_COLOR_MASK) | (kMC_purple << MEMORY_COLOR_SHIFT);
+    ptr->word = word | MEMORY_BUFFERED;
+    if ((word & MEMORY_BUFFERED) == 0)
+      array_push(roots, ptr);
     return (data);
   }
 
-  ptr->alive = false;
-  if (ptr->free != NULL)
-    ptr->free(data);
+  // no references and, with assertions, not alive anymore
+  word &= (MEMORY_ONE - 1) & ~MEMORY_ALIVE_BIT & ~MEMORY_COLOR_MASK;
+  ptr->word = word | (kMC_pending << MEMORY_COLOR_SHIFT);
+  array_push(pending, ptr);
+  memory_drain(budget != 0 ? budget : SIZE_MAX);
+  return (NULL);
+}
 
-  free(ptr);
+size_t memory_overhead(void) { //
+  return offsetof(struct s_memory, data);
+}
 
-  return (NULL);
+void *memory_place(void *block, unsigned kind) {
+  struct s_memory *self = block;
+  assert(kind < MEMORY_KINDS);
+  assert((uintptr_t)self->data % sizeof(void *) == 0);
+  memset(self, 0, sizeof(*self));
+  self->kind = kind;
+#if MEMORY_ALIVE
+  self->alive = true;
+#endif
+  self->count = MEMORY_STICKY;
+  return (self->data);
 }
@@ -1,18 +1,93 @@
 #ifndef __MEMORY_H_
 #define __MEMORY_H_
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
-    void *memory_create(size_t size, void (*free)(void *ptr));
+    // Blocks are counted by kind, a small number the caller chooses, such as
+    // the type of the object the block holds; memory_create uses kind 0.
+#define MEMORY_KINDS 16
+    // retains are counted by the power of two of the number of references
+    // they leave the block with
+#define MEMORY_BUCKETS 8
+
+    struct s_memory_stats
+    {
+        size_t allocs;
+        size_t frees;
+        size_t live;
+        size_t bytes;
+        size_t peak;
+        size_t retains;
+        size_t releases;
+        // retains leaving [2^i, 2^(i+1)) references, the last bucket open
+        size_t counts[MEMORY_BUCKETS];
+    };
+
+    // The destructor of a kind is called on each block of the kind before it
+    // is freed, to release what the block references.
+    void memory_set_destructor(unsigned kind, void (*free)(void *ptr));
+    void *memory_create(size_t size);
+    void *memory_create_kind(size_t size, unsigned kind);
+
+    // Blocks of `kind` up to `size` bytes are taken from an arena of their
+    // own, rather than shared with the other kinds of the same size.
+    void memory_set_arena(unsigned kind, size_t size);
+
+    const struct s_memory_stats *memory_stats(unsigned kind);
+
+    // Blocks are freed without recursion, once their last reference is
+    // released. With a budget other than 0, only that many are freed at a
+    // time, the others when more memory is allocated or memory_drain is
+    // called; memory_drain(SIZE_MAX) frees all of them.
+    void memory_set_budget(size_t budget);
+    void memory_drain(size_t limit);
+
+    // Reference cycles are collected by memory_collect, which runs by itself
+    // once enough possible roots were gathered. The blocks of a kind that can
+    // close a cycle list the blocks they reference through `children`; those
+    // of a `root` kind are the possible roots of cycles.
+    typedef void memory_children_t(void *data, void (*visit)(void *data));
+    void memory_set_children(unsigned kind, memory_children_t *children,
+                             bool root);
+    void memory_collect(void);
+
+    struct s_memory_cycles
+    {
+        size_t collections;
+        // blocks freed by the collector
+        size_t collected;
+        size_t nanoseconds;
+        // longest collection
+        size_t longest;
+    };
+
+    const struct s_memory_cycles *memory_cycles(void);
 
     void *memory_retain(void *ptr);
     void *memory_release(void *ptr);
 
+    // Blocks laid out in memory the allocator does not own, such as a mapped
+    // image: memory_place writes at `block` the header of a block of `kind`
+    // that is never freed, and returns the data that follows it,
+    // memory_overhead bytes further, which must be aligned like a pointer.
+    size_t memory_overhead(void);
+    void *memory_place(void *block, unsigned kind);
+
+    // The kind of a block is in the low bits of its header, the 32-bit word
+    // right before its data. A block defined statically, and never retained
+    // nor released, may have a header that only holds its kind.
+    static inline unsigned memory_kind(const void *ptr)
+    {
+        return ((const uint32_t *)ptr)[-1] & (MEMORY_KINDS - 1);
+    }
+
 #ifdef __cplusplus
 }
 #endif
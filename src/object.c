@@ -1,36 +1,139 @@
 #include "object.h"
 #include "memory.h"
+#include "object_compile.h"
 #include "object_parse.h"
+#include "profile.h"
 
 #include <assert.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+// The global frame keeps its bindings in an open-addressing table keyed on
+// symbol identity, so that looking up a global does not depend on how many
+// definitions a session has made.
+struct s_binding {
+  object_t key;
+  object_t value;
+};
+
+struct s_table {
+  size_t count;
+  size_t capacity;
+  struct s_binding *bindings;
+};
+
+static struct s_table *table_create(void) {
+  struct s_table *self = malloc(sizeof(*self));
+  assert(self != NULL);
+  self->count = 0;
+  self->capacity = 64;
+  self->bindings = calloc(self->capacity, sizeof(*self->bindings));
+  assert(self->bindings != NULL);
+  return (self);
+}
+
+static void table_delete(struct s_table *self) {
+  for (size_t i = 0; i < self->capacity; i++) {
+    if (self->bindings[i].key == NULL)
+      continue;
+    object_release(self->bindings[i].value);
+    object_release(self->bindings[i].key);
+  }
+  free(self->bindings);
+  free(self);
+}
+
+static struct s_binding *table_slot(struct s_binding *bindings,
+                                    size_t capacity, object_t key) {
+  size_t idx = key->symbol.hash & (capacity - 1);
+  while (bindings[idx].key != NULL && bindings[idx].key != key)
+    idx = (idx + 1) & (capacity - 1);
+  return (&bindings[idx]);
+}
+
+static void table_grow(struct s_table *self) {
+  size_t capacity = self->capacity * 2;
+  struct s_binding *bindings = calloc(capacity, sizeof(*bindings));
+  assert(bindings != NULL);
+
+  for (size_t i = 0; i < self->capacity; i++) {
+    if (self->bindings[i].key == NULL)
+      continue;
+    *table_slot(bindings, capacity, self->bindings[i].key) = self->bindings[i];
+  }
+
+  free(self->bindings);
+  self->bindings = bindings;
+  self->capacity = capacity;
+}
+
+static object_t table_find(struct s_table *self, object_t key) {
+  return table_slot(self->bindings, self->capacity, key)->value;
+}
+
+static void table_add(struct s_table *self, object_t key, object_t value) {
+  if (2 * (self->count + 1) > self->capacity)
+    table_grow(self);
+
+  struct s_binding *binding = table_slot(self->bindings, self->capacity, key);
+  object_retain(value);
+  if (binding->key == NULL) {
+    binding->key = object_retain(key);
+    self->count += 1;
+  } else {
+    object_release(binding->value);
+  }
+  binding->value = value;
+}
+
 static void unmake(void *ptr) {
   object_t object = ptr;
-  switch (object->type) {
+  switch (object_type(object)) {
   case kOT_list:
-    memory_release(object->list.tail);
-    memory_release(object->list.head);
+    object_release(object->list.tail);
+    object_release(object->list.head);
     break;
   case kOT_env:
-    memory_release(object->env.vars);
+    if (object->env.table != NULL)
+      table_delete(object->env.table);
+    for (size_t i = 0; i < object->env.count; i++)
+      if (object->env.slots[i] != NULL)
+        object_release(object->env.slots[i]);
+    object_release(object->env.names);
+    object_release(object->env.parent);
+    object_release(object->env.vars);
     break;
   case kOT_symbol:
   case kOT_constant:
-  case kOT_integer:
   case kOT_string:
   case kOT_primitive:
     break;
   case kOT_function:
-    // memory_release(object->function.env);
-    memory_release(object->function.body);
-    memory_release(object->function.params);
+    object_release(object->function.env);
+    if (object->function.code != NULL)
+      object_release(object->function.code);
+    if (object->function.name != NULL)
+      object_release(object->function.name);
+    object_release(object->function.body);
+    object_release(object->function.params);
+    break;
+  case kOT_code:
+    for (size_t i = 0; i < object->code.count; i++)
+      object_release(object->code.constants[i]);
+    free(object->code.constants);
+    free(object->code.ops);
+    free(object->code.caches);
     break;
   default:
     assert(false);
@@ -38,60 +141,144 @@ static void unmake(void *ptr) {
   }
 }
 
-static object_t make(object_type_t type, size_t size) {
-  size += offsetof(struct s_object, _);
-  object_t self = memory_create(size, unmake);
-  self->type = type;
-  return (self);
+static void children(void *ptr, void (*visit)(void *data)) {
+  object_t object = ptr;
+#define VISIT(_object)                                                         \
+  do {                                                                         \
+    if ((_object) != NULL && !object_is_immortal(_object))                     \
+      visit(_object);                                                          \
+  } while (0)
+  switch (object_type(object)) {
+  case kOT_list:
+    VISIT(object->list.head);
+    VISIT(object->list.tail);
+    break;
+  case kOT_env:
+    if (object->env.table != NULL)
+      for (size_t i = 0; i < object->env.table->capacity; i++) {
+        VISIT(object->env.table->bindings[i].key);
+        VISIT(object->env.table->bindings[i].value);
+      }
+    for (size_t i = 0; i < object->env.count; i++)
+      VISIT(object->env.slots[i]);
+    VISIT(object->env.names);
+    VISIT(object->env.parent);
+    VISIT(object->env.vars);
+    break;
+  case kOT_function:
+    VISIT(object->function.env);
+    VISIT(object->function.code);
+    VISIT(object->function.name);
+    VISIT(object->function.body);
+    VISIT(object->function.params);
+    break;
+  case kOT_code:
+    for (size_t i = 0; i < object->code.count; i++)
+      VISIT(object->code.constants[i]);
+    break;
+  default:
+    assert(false);
+    break;
+  }
+#undef VISIT
+}
+
+// A closure references the frame it was made in, which may bind it: only
+// frames and functions can be the way into a cycle.
+__attribute__((constructor)) static void object_init(void) {
+  for (object_type_t type = kOT_list; type <= kOT_code; type++)
+    memory_set_destructor(type, unmake);
+  memory_set_children(kOT_list, children, false);
+  memory_set_arena(kOT_list, sizeof(((struct s_object *)NULL)->list));
+  memory_set_children(kOT_env, children, true);
+  memory_set_children(kOT_function, children, true);
+  memory_set_children(kOT_code, children, false);
+}
+
+static object_t make(object_type_t type, size_t size) { //
+  return memory_create_kind(size, type);
 }
 
+// nil and true are statically allocated: they are never reference counted
+// and are compared by identity.
+_Static_assert(offsetof(struct s_object_static, object) ==
+                   offsetof(struct s_object_static, header) + sizeof(uint32_t),
+               "the header of a static object must be right before it");
+
+struct s_object_static object_static_nil = {
+    .header = kOT_constant, .object = {.constant = kCT_nil}};
+struct s_object_static object_static_true = {
+    .header = kOT_constant, .object = {.constant = kCT_true}};
+
 static object_t make_constant(constant_type_t constant) {
-  object_t self = make(kOT_constant, sizeof(self->constant));
-  self->constant = constant;
-  return (self);
+  switch (constant) {
+  case kCT_nil:
+    return (&object_nil);
+  case kCT_true:
+    return (&object_true);
+  default:
+    assert(false);
+    return (NULL);
+  }
 }
 
-static object_t make_integer(int integer) {
-  object_t self = make(kOT_integer, sizeof(self->integer));
-  self->integer = integer;
-  return (self);
+_Static_assert(sizeof(intptr_t) > sizeof(int),
+               "an int and its tag bit must fit in a pointer");
+
+static object_t make_integer(int integer) { //
+  return ((object_t)((((uintptr_t)(intptr_t)integer) << 1) | 1));
 }
 
 static object_t make_list(object_t head, object_t tail) {
   assert(head != NULL);
   assert(tail != NULL);
   object_t self = make(kOT_list, sizeof(self->list));
-  self->list.head = memory_retain(head);
-  self->list.tail = memory_retain(tail);
-  self->list.last = NULL;
+  self->list.head = object_retain(head);
+  self->list.tail = object_retain(tail);
   return (self);
 }
 
-static object_t make_symbol(const char *symbol) {
-  assert(symbol != NULL);
-  object_t self = make(kOT_symbol, strlen(symbol) + sizeof(self->symbol));
-  strcpy(self->symbol, symbol);
+static object_t make_symbol(const char *name, size_t length, size_t hash) {
+  assert(name != NULL);
+  object_t self = make(kOT_symbol, length + sizeof(self->symbol));
+  self->symbol.hash = hash;
+  self->symbol.local = false;
+  memcpy(self->symbol.name, name, length);
+  self->symbol.name[length] = 0;
   return (self);
 }
 
-static object_t make_string(const char *string) {
+static object_t make_string(const char *string, size_t length) {
   assert(string != NULL);
-  object_t self = make(kOT_string, strlen(string) + sizeof(self->string));
-  strcpy(self->string, string);
+  object_t self = make(kOT_string, length + sizeof(self->string));
+  memcpy(self->string, string, length);
+  self->string[length] = 0;
   return (self);
 }
 
-static object_t make_env(object_t vars, object_t parent) {
-  assert(vars != NULL);
-  object_t self = make(kOT_env, sizeof(self->env));
-  self->env.vars = memory_retain(vars);
-  self->env.parent = parent;
+static object_t make_env(object_t parent, object_t names, size_t count) {
+  assert(parent != NULL);
+  assert(names != NULL);
+  object_t self = NULL;
+  size_t size = sizeof(self->env);
+  if (count > 1)
+    size += (count - 1) * sizeof(self->env.slots[0]);
+  self = make(kOT_env, size);
+  self->env.vars = object_list_create();
+  self->env.parent = object_retain(parent);
+  self->env.table = NULL;
+  self->env.names = object_retain(names);
+  self->env.count = count;
   return (self);
 }
 
-static object_t make_primitive(primitive_t primitive) {
+static object_t make_primitive(primitive_t *primitive, special_t *special,
+                               builtin_t builtin) {
+  assert((primitive == NULL) != (special == NULL));
   object_t self = make(kOT_primitive, sizeof(self->primitive));
-  self->primitive = primitive;
+  self->primitive.function = primitive;
+  self->primitive.special = special;
+  self->primitive.builtin = builtin;
   return (self);
 }
 
@@ -99,18 +286,120 @@ static object_t make_function(object_type_t type, object_t params,
                               object_t body, object_t env) {
   assert(type == kOT_function);
   object_t self = make(type, sizeof(self->function));
-  self->function.params = memory_retain(params);
-  self->function.body = memory_retain(body);
-  self->function.env = env;
+  self->function.params = object_retain(params);
+  self->function.body = object_retain(body);
+  self->function.env = object_retain(env);
+  self->function.code = NULL;
+  self->function.name = NULL;
+  return (self);
+}
+
+static object_t make_code(uint32_t *ops, size_t size, object_t *constants,
+                          size_t count, size_t lookups) {
+  assert(ops != NULL);
+  object_t self = make(kOT_code, sizeof(self->code));
+  self->code.ops = ops;
+  self->code.size = size;
+  self->code.constants = constants;
+  self->code.count = count;
+  self->code.caches = calloc(lookups, sizeof(*self->code.caches));
+  assert(lookups == 0 || self->code.caches != NULL);
+  self->code.lookups = lookups;
+  self->code.builtins = object_builtins_version;
   return (self);
 }
 
+// Every symbol is interned: there is exactly one object per name, so symbols
+// can be compared by identity. The table owns one reference on each symbol,
+// which keeps them alive for the whole process.
+static struct {
+  size_t count;
+  size_t capacity;
+  object_t *symbols;
+} symbols = {0, 0, NULL};
+
+static size_t symbol_hash(const char *name, size_t length) {
+  size_t hash = 14695981039346656037UL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)name[i];
+    hash *= 1099511628211UL;
+  }
+  return hash;
+}
+
+static void symbols_grow(void) {
+  size_t capacity = symbols.capacity == 0 ? 256 : symbols.capacity * 2;
+  object_t *table = calloc(capacity, sizeof(*table));
+  assert(table != NULL);
+
+  for (size_t i = 0; i < symbols.capacity; i++) {
+    object_t symbol = symbols.symbols[i];
+    if (symbol == NULL)
+      continue;
+    size_t idx = symbol->symbol.hash & (capacity - 1);
+    while (table[idx] != NULL)
+      idx = (idx + 1) & (capacity - 1);
+    table[idx] = symbol;
+  }
+
+  free(symbols.symbols);
+  symbols.symbols = table;
+  symbols.capacity = capacity;
+}
+
+static object_t symbol_intern(const char *name, size_t length) {
+  if (2 * (symbols.count + 1) > symbols.capacity)
+    symbols_grow();
+
+  size_t hash = symbol_hash(name, length);
+  size_t idx = hash & (symbols.capacity - 1);
+  for (object_t symbol; (symbol = symbols.symbols[idx]) != NULL;
+       idx = (idx + 1) & (symbols.capacity - 1)) {
+    if (symbol->symbol.hash == hash &&
+        strncmp(symbol->symbol.name, name, length) == 0 &&
+        symbol->symbol.name[length] == 0)
+      return (symbol);
+  }
+
+  symbols.count += 1;
+  return (symbols.symbols[idx] = make_symbol(name, length, hash));
+}
+
+// Makes `symbol`, read from an image, the canonical symbol of its name, or
+// returns the one already interned under that name, which then stands for it.
+static object_t symbol_adopt(object_t symbol) {
+  if (2 * (symbols.count + 1) > symbols.capacity)
+    symbols_grow();
+
+  size_t idx = symbol->symbol.hash & (symbols.capacity - 1);
+  for (object_t other; (other = symbols.symbols[idx]) != NULL;
+       idx = (idx + 1) & (symbols.capacity - 1)) {
+    if (other->symbol.hash == symbol->symbol.hash &&
+        strcmp(other->symbol.name, symbol->symbol.name) == 0) {
+      other->symbol.local = other->symbol.local || symbol->symbol.local;
+      return (other);
+    }
+  }
+
+  symbols.count += 1;
+  symbols.symbols[idx] = symbol;
+  return (symbol);
+}
+
 object_t object_create_symbol(const char *name) { //
-  return make_symbol(name);
+  return object_retain(symbol_intern(name, strlen(name)));
+}
+
+object_t object_create_symbol_slice(const char *name, size_t length) { //
+  return object_retain(symbol_intern(name, length));
 }
 
 object_t object_create_string(const char *value) { //
-  return make_string(value);
+  return make_string(value, strlen(value));
+}
+
+object_t object_create_string_slice(const char *value, size_t length) { //
+  return make_string(value, length);
 }
 
 object_t object_create_integer(int value) { //
@@ -121,11 +410,25 @@ object_t object_list_create(void) { //
   return make_constant(kCT_nil);
 }
 
+object_t object_create_boolean(bool value) { //
+  return make_constant(value ? kCT_true : kCT_nil);
+}
+
+object_t object_create_function(object_t params, object_t body,
+                                object_t env) {
+  return make_function(kOT_function, params, body, env);
+}
+
+object_t object_create_code(uint32_t *ops, size_t size, object_t *constants,
+                            size_t count, size_t lookups) {
+  return make_code(ops, size, constants, count, lookups);
+}
+
 size_t object_list_length(object_t object) {
   size_t result = 0;
   object_t list = object;
   while (object_list_is_empty(list) == false) {
-    assert(list->type == kOT_list);
+    assert(object_type(list) == kOT_list);
     list = list->list.tail;
     result += 1;
   }
@@ -133,66 +436,59 @@ size_t object_list_length(object_t object) {
   return result;
 }
 
-void object_list_push(object_t *list_ptr, object_t object) {
-  object_t list = *list_ptr;
-  if (object_list_is_empty(list)) {
-    list = make_list(object, list);
-    list->list.last = list;
-    memory_release(*list_ptr);
-  } else {
-    assert(list->type == kOT_list);
-    assert(object_list_is_empty(list->list.last->list.tail));
-    memory_release(list->list.last->list.tail);
-
-    object_t node = NULL;
-    object_new(last, object_list_create(), { //
-      node = make_list(object, last);
-    });
-
-    list->list.last = list->list.last->list.tail = node;
-  }
-
-  assert(list->type == kOT_list);
-  *list_ptr = list;
+void object_list_builder_init(struct s_list_builder *self) {
+  self->list = object_list_create();
+  self->last = NULL;
 }
 
-bool object_list_is_empty(object_t object) {
-  assert(object != NULL);
-  return ((object->type == kOT_constant) && (object->constant == kCT_nil));
+void object_list_builder_push(struct s_list_builder *self, object_t object) {
+  object_t node = make_list(object, &object_nil);
+  if (self->last == NULL) {
+    object_release(self->list);
+    self->list = node;
+  } else {
+    assert(object_list_is_empty(self->last->list.tail));
+    // nil is immortal: the tail is replaced without being released
+    self->last->list.tail = node;
+  }
+  self->last = node;
 }
 
-static object_t object_eval_list(object_t env, object_t object) {
-  if (object_list_is_empty(object) == true)
-    return object_list_create();
-  assert(object->type == kOT_list);
+size_t object_version = 1;
+size_t object_builtins_version = 0;
 
-  object_t head = object_eval(env, object->list.head);
-  object_t tail = object_eval_list(env, object->list.tail);
-  object_t result = make_list(head, tail);
-  memory_release(head);
-  memory_release(tail);
-
-  assert(result->type == kOT_list);
-  return result;
-}
-
-object_t env_find(object_t env, object_t object) {
+// Sets `*global` when the value was found in the table of the global frame.
+static object_t env_find_from(object_t env, object_t object, bool *global) {
   assert(object != NULL);
-  assert(object->type == kOT_symbol);
+  assert(object_type(object) == kOT_symbol);
 
   while (object_list_is_empty(env) == false) {
-    assert(env->type == kOT_env);
+    assert(object_type(env) == kOT_env);
+
+    if (env->env.table != NULL) {
+      object_t value = table_find(env->env.table, object);
+      if (value != NULL) {
+        *global = true;
+        return (value);
+      }
+    }
+
+    object_t *slot = env->env.slots;
+    for (object_t p = env->env.names; !object_list_is_empty(p);
+         p = p->list.tail, slot++)
+      if (p->list.head == object && *slot != NULL)
+        return (*slot);
 
     object_t vars = env->env.vars;
     assert(vars != NULL);
     while (object_list_is_empty(vars) == false) {
-      assert(vars->type == kOT_list);
+      assert(object_type(vars) == kOT_list);
       object_t pair = vars->list.head;
       assert(pair != NULL);
-      assert(pair->type == kOT_list);
+      assert(object_type(pair) == kOT_list);
       assert(pair->list.head != NULL);
-      assert(pair->list.head->type == kOT_symbol);
-      if (strcmp(pair->list.head->symbol, object->symbol) == 0) {
+      assert(object_type(pair->list.head) == kOT_symbol);
+      if (pair->list.head == object) {
         return pair->list.tail;
       }
       vars = vars->list.tail;
@@ -203,16 +499,91 @@ object_t env_find(object_t env, object_t object) {
   return (NULL);
 }
 
+static object_t env_find(object_t env, object_t object) {
+  bool global = false;
+  return env_find_from(env, object, &global);
+}
+
+// Defining a name already bound in `env` replaces its value in place.
 static void env_add(object_t env, object_t k, object_t v) {
   assert(env != NULL);
-  assert(env->type == kOT_env);
+  assert(object_type(env) == kOT_env);
+  assert(object_type(k) == kOT_symbol);
+
+  object_version += 1;
+  // code open-coding the builtin this replaces must not run anymore
+  object_t previous = env_find(env, k);
+  if (previous != NULL && previous != v &&
+      object_type(previous) == kOT_primitive &&
+      previous->primitive.builtin != kBI_none)
+    object_builtins_version += 1;
+
+  // profiles and backtraces show functions by the name they were defined as
+  if (v != NULL && object_type(v) == kOT_function &&
+      v->function.name == NULL)
+    v->function.name = object_retain(k);
+
+  if (env->env.table != NULL) {
+    table_add(env->env.table, k, v);
+    return;
+  }
+  k->symbol.local = true;
+
+  object_t *slot = env->env.slots;
+  for (object_t p = env->env.names; !object_list_is_empty(p);
+       p = p->list.tail, slot++) {
+    if (p->list.head == k) {
+      if (*slot != NULL)
+        object_release(*slot);
+      *slot = object_retain(v);
+      return;
+    }
+  }
+
+  for (object_t p = env->env.vars; !object_list_is_empty(p); p = p->list.tail) {
+    object_t pair = p->list.head;
+    if (pair->list.head == k) {
+      object_release(pair->list.tail);
+      pair->list.tail = object_retain(v);
+      return;
+    }
+  }
+
   object_new(pair, make_list(k, v), {
     object_t vars = env->env.vars;
     env->env.vars = make_list(pair, env->env.vars);
-    memory_release(vars);
+    object_release(vars);
   });
 }
 
+object_t object_create_frame(object_t parent, object_t names,
+                             size_t count) {
+  assert(object_list_length(names) == count);
+  return make_env(parent, names, count);
+}
+
+object_t object_env_find(object_t env, object_t symbol) { //
+  return env_find(env, symbol);
+}
+
+// A symbol never bound outside of the global frame is only found there, from
+// whichever frame the lookup starts: its value can be cached until the next
+// definition.
+object_t object_env_lookup(object_t env, object_t symbol,
+                           struct s_cache *cache) {
+  bool global = false;
+  object_t value = env_find_from(env, symbol, &global);
+  if (global && !symbol->symbol.local) {
+    cache->version = object_version;
+    cache->value = value;
+  }
+  return (value);
+}
+
+void object_env_add(object_t env, object_t symbol, object_t value) { //
+  env_add(env, symbol, value);
+}
+
 static void env_add_constant(object_t env, const char *name,
                              constant_type_t type) {
   object_new(key, object_create_symbol(name), {
@@ -222,12 +593,24 @@ static void env_add_constant(object_t env, const char *name,
   });
 }
 
-static void env_add_primitive(object_t env, const char *name,
-                              primitive_t primitive) {
-  object_new(key, object_create_symbol(name), {
-    object_new(value, make_primitive(primitive), { //
-      env_add(env, key, value);
-    });
+// Primitives and special forms bound in every fresh environment. Images
+// refer to them by name, as their addresses change from one build to the
+// next.
+struct s_builtin {
+  const char *name;
+  primitive_t *function;
+  special_t *special;
+  builtin_t builtin;
+};
+
+static void env_add_builtin(object_t env, const struct s_builtin *builtin) {
+  object_new(key, object_create_symbol(builtin->name), {
+    object_new(value,
+               make_primitive(builtin->function, builtin->special,
+                              builtin->builtin),
+               { //
+                 env_add(env, key, value);
+               });
   });
 }
 
@@ -239,79 +622,154 @@ static void env_add_integer(object_t env, const char *name, int integer) {
   });
 }
 
-static object_t for_each(object_t env, object_t args, bool print) {
-  object_t result = NULL;
-  while (object_list_is_empty(args) == false) {
-    if (result != NULL)
-      memory_release(result);
-    result = object_eval(env, args->list.head);
-    if (print == true)
-      object_print(result);
-    args = args->list.tail;
-  }
-  return result;
+// References held in the C locals of the tree-walker while it evaluates. A
+// frame registers the address of such a local, NULL or owning a reference,
+// and unregisters it before returning: on an error, object_error releases
+// what the registered locals still own before it unwinds their frames.
+static struct {
+  object_t **data;
+  size_t count;
+  size_t capacity;
+} owned;
+
+static void owned_grow(void) {
+  owned.capacity = owned.capacity == 0 ? 256 : owned.capacity * 2;
+  owned.data = realloc(owned.data, owned.capacity * sizeof(*owned.data));
+  assert(owned.data != NULL);
 }
 
-static object_t primitive_do(object_t env, object_t args) { //
-  return for_each(env, args, false);
+static inline size_t own(object_t *slot) {
+  if (__builtin_expect(owned.count == owned.capacity, false))
+    owned_grow();
+  owned.data[owned.count] = slot;
+  return (owned.count++);
 }
 
-static object_t primitive_print(object_t env, object_t args) { //
-  return for_each(env, args, true);
+static void disown(size_t mark) { //
+  owned.count = mark;
 }
 
-static object_t primitive_if(object_t env, object_t args) {
+static void owned_release(void) {
+  while (owned.count > 0) {
+    object_t *slot = owned.data[--owned.count];
+    if (*slot != NULL)
+      object_release(*slot);
+    *slot = NULL;
+  }
+}
+
+// The special forms below do not evaluate the form they leave in tail
+// position: they store it in `*tail` and return NULL, so that object_eval can
+// loop on it instead of recursing. When that form must be evaluated in a new
+// frame, `*env` is replaced by an owned reference on it.
+static object_t step_do(object_t *env, object_t args, object_t *tail) {
+  if (object_list_is_empty(args))
+    return (NULL);
+  while (object_list_is_empty(args->list.tail) == false) {
+    object_t value = object_eval(*env, args->list.head);
+    if (value != NULL)
+      object_release(value);
+    args = args->list.tail;
+  }
+  *tail = args->list.head;
+  return (NULL);
+}
+
+static object_t step_if(object_t *env, object_t args, object_t *tail) {
   assert(object_list_length(args) >= 2);
-  object_t condition = object_eval(env, args->list.head);
+  object_t condition = object_eval(*env, args->list.head);
   bool is_true = object_list_is_empty(condition) == false;
-  memory_release(condition);
+  object_release(condition);
 
   if (is_true) {
-    return object_eval(env, args->list.tail->list.head);
+    *tail = args->list.tail->list.head;
+    return (NULL);
   }
 
   if (object_list_is_empty(args->list.tail->list.tail))
-    return object_eval(env, args->list.tail->list.tail);
+    return object_eval(*env, args->list.tail->list.tail);
 
-  return primitive_do(env, args->list.tail->list.tail);
+  return step_do(env, args->list.tail->list.tail, tail);
 }
 
-static object_t primitive_let(object_t env, object_t args) {
+static object_t step_let(object_t *env, object_t args, object_t *tail) {
   assert(object_list_length(args) == 2);
 
-  object_t result = NULL;
-  object_new(vars, object_list_create(), {
-    object_new(new_env, make_env(vars, env), { //
-      object_t params = args->list.head;
-      args = args->list.tail;
-
-      while (object_list_is_empty(params) == false) {
-        object_t key = params->list.head;
-        assert(key->type == kOT_symbol);
-        params = params->list.tail;
-
-        assert(object_list_is_empty(params) == false);
-        object_new(value, object_eval(new_env, params->list.head), {
-          env_add(new_env, key, value);
-          params = params->list.tail;
-        });
-      }
+  size_t count = 0;
+  struct s_list_builder names;
+  object_list_builder_init(&names);
+  for (object_t p = args->list.head; !object_list_is_empty(p);
+       p = p->list.tail->list.tail, count++)
+    object_list_builder_push(&names, p->list.head);
+  object_t new_env = make_env(*env, names.list, count);
+  object_release(names.list);
+  size_t mark = own(&new_env);
+
+  object_t params = args->list.head;
+  args = args->list.tail;
+
+  while (object_list_is_empty(params) == false) {
+    object_t key = params->list.head;
+    assert(object_type(key) == kOT_symbol);
+    params = params->list.tail;
+
+    assert(object_list_is_empty(params) == false);
+    object_new(value, object_eval(new_env, params->list.head), {
+      env_add(new_env, key, value);
+      params = params->list.tail;
+    });
+  }
 
-      object_t body = args->list.head;
-      args = args->list.tail;
-      assert(object_list_is_empty(args) == true);
+  assert(object_list_is_empty(args->list.tail) == true);
+  disown(mark);
+  *tail = args->list.head;
+  *env = new_env;
+  return (NULL);
+}
 
-      result = object_eval(new_env, body);
-    });
-  });
+// Evaluates what a step left in tail position, for callers that cannot loop.
+static object_t step_finish(object_t env, object_t next, object_t result,
+                            object_t tail) {
+  // the reference on `next` when it is a frame of its own
+  object_t frame = next != env ? next : NULL;
+  size_t mark = own(&frame);
+  if (tail != NULL)
+    result = object_eval(next, tail);
+  disown(mark);
+  if (frame != NULL)
+    object_release(frame);
   return (result);
 }
 
+static object_t primitive_do(object_t env, object_t args) {
+  object_t next = env, tail = NULL;
+  object_t result = step_do(&next, args, &tail);
+  return step_finish(env, next, result, tail);
+}
+
+static object_t primitive_print(size_t argc, object_t *argv) {
+  for (size_t i = 0; i < argc; i++)
+    object_print(argv[i]);
+  return argc > 0 ? object_retain(argv[argc - 1]) : NULL;
+}
+
+static object_t primitive_if(object_t env, object_t args) {
+  object_t next = env, tail = NULL;
+  object_t result = step_if(&next, args, &tail);
+  return step_finish(env, next, result, tail);
+}
+
+static object_t primitive_let(object_t env, object_t args) {
+  object_t next = env, tail = NULL;
+  object_t result = step_let(&next, args, &tail);
+  return step_finish(env, next, result, tail);
+}
+
 static object_t primitive_define(object_t env, object_t args) {
   assert(object_list_length(args) == 2);
 
   object_t key = args->list.head;
-  assert(key->type == kOT_symbol);
+  assert(object_type(key) == kOT_symbol);
   object_t value = object_eval(env, args->list.tail->list.head);
   env_add(env, key, value);
   return value;
@@ -326,7 +784,7 @@ static object_t primitive_quote(object_t env, object_t args) { //
   assert(object_list_length(args) == 1);
   assert(env != NULL);
   ((void)env);
-  return memory_retain(args->list.head);
+  return object_retain(args->list.head);
 }
 
 static object_t primitive_eval(object_t env, object_t args) { //
@@ -334,23 +792,24 @@ static object_t primitive_eval(object_t env, object_t args) { //
   assert(env != NULL);
   ((void)env);
 
-  object_t result = NULL;
-  object_new(value, object_eval(env, args->list.head), { //
-    result = object_eval(env, value);
-  });
+  object_t value = object_eval(env, args->list.head);
+  if (value == NULL)
+    return (NULL);
+  size_t mark = own(&value);
+  object_t result = object_run(env, value);
+  disown(mark);
+  object_release(value);
   return (result);
 }
 
-static object_t primitive_read(object_t env, object_t args) { //
-  assert(object_list_length(args) == 1);
-  assert(env != NULL);
-  ((void)env);
+static object_t primitive_read(size_t argc, object_t *argv) { //
+  assert(argc == 1);
+  ((void)argc);
+  assert(object_type(argv[0]) == kOT_string);
 
   object_t result = NULL;
-  object_new(value, object_eval(env, args->list.head), {      //
-    stream_new(s, stream_create_from_string(value->string), { //
-      result = object_parse(s);
-    });
+  stream_new(s, stream_create_from_string(argv[0]->string), { //
+    result = object_parse(s);
   });
   return (result);
 }
@@ -363,272 +822,718 @@ static object_t primitive_defun(object_t env, object_t args) {
   return func;
 }
 
-static object_t primitive_eq(object_t env, object_t args) {
-  assert(object_list_length(args) == 2);
+#define primitive_compare(_op)                                                 \
+  assert(argc == 2);                                                           \
+  ((void)argc);                                                                \
+  object_t argl = argv[0], argr = argv[1];                                     \
+  if (object_type(argl) != object_type(argr))                                  \
+    return object_list_create();                                               \
+  switch (object_type(argl)) {                                                 \
+  case kOT_integer:                                                            \
+    return object_create_boolean(object_integer(argl) _op                      \
+                                 object_integer(argr));                        \
+  default:                                                                     \
+    assert(false);                                                             \
+    return object_list_create();                                               \
+  }
 
-  object_t result = object_list_create();
-  object_new(argl, object_eval(env, args->list.head), {
-    object_new(argr, object_eval(env, args->list.tail->list.head), {
-      if (argl->type == argr->type) {
-        switch (argl->type) {
-        case kOT_integer: {
-          if (argl->integer == argr->integer) {
-            memory_release(result);
-            result = make_constant(kCT_true);
-          }
-          break;
-        }
-        default:
-          assert(false);
-          break;
-        }
-      }
-    });
-  });
-  return result;
+static object_t primitive_eq(size_t argc, object_t *argv) {
+  primitive_compare(==);
 }
-
-static object_t primitive_lt(object_t env, object_t args) {
-  assert(object_list_length(args) == 2);
-
-  object_t result = object_list_create();
-  object_new(argl, object_eval(env, args->list.head), {
-    object_new(argr, object_eval(env, args->list.tail->list.head), {
-      if (argl->type == argr->type) {
-        switch (argl->type) {
-        case kOT_integer: {
-          if (argl->integer < argr->integer) {
-            memory_release(result);
-            result = make_constant(kCT_true);
-          }
-          break;
-        }
-        default:
-          assert(false);
-          break;
-        }
-      }
-    });
-  });
-  return result;
+static object_t primitive_lt(size_t argc, object_t *argv) {
+  primitive_compare(<);
 }
-
-static object_t primitive_gt(object_t env, object_t args) {
-  assert(object_list_length(args) == 2);
-
-  object_t result = object_list_create();
-  object_new(argl, object_eval(env, args->list.head), {
-    object_new(argr, object_eval(env, args->list.tail->list.head), {
-      if (argl->type == argr->type) {
-        switch (argl->type) {
-        case kOT_integer: {
-          if (argl->integer > argr->integer) {
-            memory_release(result);
-            result = make_constant(kCT_true);
-          }
-          break;
-        }
-        default:
-          assert(false);
-          break;
-        }
-      }
-    });
-  });
-  return result;
+static object_t primitive_gt(size_t argc, object_t *argv) {
+  primitive_compare(>);
 }
-
-static object_t primitive_le(object_t env, object_t args) {
-  assert(object_list_length(args) == 2);
-
-  object_t result = object_list_create();
-  object_new(argl, object_eval(env, args->list.head), {
-    object_new(argr, object_eval(env, args->list.tail->list.head), {
-      if (argl->type == argr->type) {
-        switch (argl->type) {
-        case kOT_integer: {
-          if (argl->integer <= argr->integer) {
-            memory_release(result);
-            result = make_constant(kCT_true);
-          }
-          break;
-        }
-        default:
-          assert(false);
-          break;
-        }
-      }
-    });
-  });
-  return result;
+static object_t primitive_le(size_t argc, object_t *argv) {
+  primitive_compare(<=);
 }
-
-static object_t primitive_ge(object_t env, object_t args) {
-  assert(object_list_length(args) == 2);
-
-  object_t result = object_list_create();
-  object_new(argl, object_eval(env, args->list.head), {
-    object_new(argr, object_eval(env, args->list.tail->list.head), {
-      if (argl->type == argr->type) {
-        switch (argl->type) {
-        case kOT_integer: {
-          if (argl->integer >= argr->integer) {
-            memory_release(result);
-            result = make_constant(kCT_true);
-          }
-          break;
-        }
-        default:
-          assert(false);
-          break;
-        }
-      }
-    });
-  });
-  return result;
+static object_t primitive_ge(size_t argc, object_t *argv) {
+  primitive_compare(>=);
 }
 
 #define primitive_arithmetic(_sign)                                            \
-  assert(object_list_length(args) > 1);                                        \
-  bool first = true;                                                           \
-  int result = 0;                                                              \
-  do {                                                                         \
-    assert(args->type == kOT_list);                                            \
-    object_t value = object_eval(env, args->list.head);                        \
-    assert(value->type == kOT_integer);                                        \
-    if (first) {                                                               \
-      first = false;                                                           \
-      result = value->integer;                                                 \
-    } else {                                                                   \
-      result = result _sign value->integer;                                    \
-    }                                                                          \
-    memory_release(value);                                                     \
-    args = args->list.tail;                                                    \
-  } while (object_list_is_empty(args) == false);                               \
+  assert(argc > 1);                                                            \
+  assert(object_type(argv[0]) == kOT_integer);                                 \
+  int result = object_integer(argv[0]);                                        \
+  for (size_t i = 1; i < argc; i++) {                                          \
+    assert(object_type(argv[i]) == kOT_integer);                               \
+    result = result _sign object_integer(argv[i]);                             \
+  }                                                                            \
   return make_integer(result)
 
-static object_t primitive_add(object_t env, object_t args) {
+static object_t primitive_add(size_t argc, object_t *argv) {
   primitive_arithmetic(+);
 }
-static object_t primitive_sub(object_t env, object_t args) {
+static object_t primitive_sub(size_t argc, object_t *argv) {
   primitive_arithmetic(-);
 }
-static object_t primitive_mul(object_t env, object_t args) {
+static object_t primitive_mul(size_t argc, object_t *argv) {
   primitive_arithmetic(*);
 }
-static object_t primitive_div(object_t env, object_t args) {
+static object_t primitive_div(size_t argc, object_t *argv) {
   primitive_arithmetic(/);
 }
 
-static object_t c_open(object_t env, object_t args) {
-  assert(object_list_length(args) == 2);
-  object_t result = NULL;
-  object_new(pathname, object_eval(env, args->list.head), {
-    assert(pathname->type == kOT_string);
-    object_new(flags, object_eval(env, args->list.tail->list.head), {
-      assert(flags->type == kOT_integer);
-      result = object_create_integer(open(pathname->string, flags->integer));
-    });
-  });
-  return result;
+static object_t c_open(size_t argc, object_t *argv) {
+  assert(argc == 2);
+  ((void)argc);
+  assert(object_type(argv[0]) == kOT_string);
+  assert(object_type(argv[1]) == kOT_integer);
+  return object_create_integer(
+      open(argv[0]->string, object_integer(argv[1])));
 }
 
-static object_t c_close(object_t env, object_t args) {
-  assert(object_list_length(args) == 1);
-  object_t result = NULL;
-  object_new(fp, object_eval(env, args->list.head), {
-    assert(fp->type == kOT_integer);
-    result = object_create_integer(close(fp->integer));
-  });
-  return result;
+static object_t c_close(size_t argc, object_t *argv) {
+  assert(argc == 1);
+  ((void)argc);
+  assert(object_type(argv[0]) == kOT_integer);
+  return object_create_integer(close(object_integer(argv[0])));
 }
 
 // static object_t c_read(object_t env, object_t args) {
 //   assert(object_list_length(args) == 2);
 
 //   object_new(fp, object_eval(env, args->list.head), {
-//     assert(fp->type == kOT_integer);
+//     assert(object_type(fp) == kOT_integer);
 //     object_new(size, object_eval(env, args->list.tail->list.head), {
-//       assert(size->type == kOT_integer);
+//       assert(object_type(size) == kOT_integer);
 
-//       char *buffer = memory_create(size->integer);
-//       ssize_t result = read(fp->integer, buffer, size->integer);
-//       memory_release(buffer);
+//       char *buffer = memory_create(object_integer(size));
+//       ssize_t result = read(object_integer(fp), buffer,
+//                             object_integer(size));
+//       object_release(buffer);
 
 //       return object_create_integer(result);
 //     });
 //   });
 // }
 
+// Memory kinds are the object types and streams; the blocks of an image are
+// counted as "other".
+static const char *const kinds[MEMORY_KINDS] = {
+    [0] = "other",
+    [kOT_list] = "list",
+    [kOT_symbol] = "symbol",
+    [kOT_string] = "string",
+    [kOT_env] = "env",
+    [kOT_primitive] = "primitive",
+    [kOT_function] = "function",
+    [kOT_code] = "code",
+    [STREAM_KIND] = "stream",
+};
+
+static object_t stats_integer(size_t value) {
+  return object_create_integer(value < INT_MAX ? (int)value : INT_MAX);
+}
+
+// (memory-stats) is a list with an entry per kind of block allocated so far:
+// (kind allocs frees live bytes peak retains releases (counts...)), where the
+// counts are retains by power of two of the references they leave. A last
+// entry (cycles collections collected nanoseconds longest) tells what the
+// cycle collector did.
+static object_t primitive_memory_stats(size_t argc, object_t *argv) {
+  assert(argc == 0);
+  ((void)argc);
+  ((void)argv);
+
+  struct s_list_builder result;
+  object_list_builder_init(&result);
+  for (unsigned kind = 0; kind < MEMORY_KINDS; kind++) {
+    const struct s_memory_stats *stats = memory_stats(kind);
+    if (kinds[kind] == NULL || (stats->allocs == 0 && stats->retains == 0))
+      continue;
+
+    const size_t fields[] = {stats->allocs, stats->frees,   stats->live,
+                             stats->bytes,  stats->peak,    stats->retains,
+                             stats->releases};
+    struct s_list_builder entry, counts;
+    object_list_builder_init(&entry);
+    object_new(name, object_create_symbol(kinds[kind]), { //
+      object_list_builder_push(&entry, name);
+    });
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+      object_new(value, stats_integer(fields[i]), { //
+        object_list_builder_push(&entry, value);
+      });
+    object_list_builder_init(&counts);
+    for (size_t i = 0; i < MEMORY_BUCKETS; i++)
+      object_new(value, stats_integer(stats->counts[i]), { //
+        object_list_builder_push(&counts, value);
+      });
+    object_list_builder_push(&entry, counts.list);
+    object_release(counts.list);
+    object_list_builder_push(&result, entry.list);
+    object_release(entry.list);
+  }
+
+  const struct s_memory_cycles *cycles = memory_cycles();
+  const size_t fields[] = {cycles->collections, cycles->collected,
+                           cycles->nanoseconds, cycles->longest};
+  struct s_list_builder entry;
+  object_list_builder_init(&entry);
+  object_new(name, object_create_symbol("cycles"), { //
+    object_list_builder_push(&entry, name);
+  });
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+    object_new(value, stats_integer(fields[i]), { //
+      object_list_builder_push(&entry, value);
+    });
+  object_list_builder_push(&result, entry.list);
+  object_release(entry.list);
+  return (result.list);
+}
+
+void object_dump_memory_stats(FILE *fp) {
+  fprintf(fp, "%-10s %10s %10s %10s %12s %12s %12s %12s\n", "kind", "allocs",
+          "frees", "live", "bytes", "peak", "retains", "releases");
+  for (unsigned kind = 0; kind < MEMORY_KINDS; kind++) {
+    const struct s_memory_stats *stats = memory_stats(kind);
+    if (kinds[kind] == NULL || (stats->allocs == 0 && stats->retains == 0))
+      continue;
+    fprintf(fp, "%-10s %10zu %10zu %10zu %12zu %12zu %12zu %12zu\n",
+            kinds[kind], stats->allocs, stats->frees, stats->live,
+            stats->bytes, stats->peak, stats->retains, stats->releases);
+  }
+
+  fprintf(fp, "%-10s", "refs");
+  for (size_t i = 0; i < MEMORY_BUCKETS; i++) {
+    char label[32];
+    snprintf(label, sizeof(label), "%s%zu", i + 1 < MEMORY_BUCKETS ? "" : ">=",
+             (size_t)1 << i);
+    fprintf(fp, " %10s", label);
+  }
+  fprintf(fp, "\n");
+  for (unsigned kind = 0; kind < MEMORY_KINDS; kind++) {
+    const struct s_memory_stats *stats = memory_stats(kind);
+    if (kinds[kind] == NULL || stats->retains == 0)
+      continue;
+    fprintf(fp, "%-10s", kinds[kind]);
+    for (size_t i = 0; i < MEMORY_BUCKETS; i++)
+      fprintf(fp, " %10zu", stats->counts[i]);
+    fprintf(fp, "\n");
+  }
+
+  const struct s_memory_cycles *cycles = memory_cycles();
+  fprintf(fp, "cycles: %zu collections, %zu blocks, %zu us, longest %zu us\n",
+          cycles->collections, cycles->collected, cycles->nanoseconds / 1000,
+          cycles->longest / 1000);
+}
+
+static const struct s_builtin builtins[] = {
+    {"if", NULL, primitive_if, kBI_if},
+    {"do", NULL, primitive_do, kBI_do},
+    {"let", NULL, primitive_let, kBI_let},
+    {"define", NULL, primitive_define, kBI_define},
+    {"defun", NULL, primitive_defun, kBI_defun},
+    {"lambda", NULL, primitive_lambda, kBI_lambda},
+    {"quote", NULL, primitive_quote, kBI_quote},
+    {"print", primitive_print, NULL, kBI_none},
+    {"eval", NULL, primitive_eval, kBI_none},
+    {"read", primitive_read, NULL, kBI_none},
+    {"memory-stats", primitive_memory_stats, NULL, kBI_none},
+
+    {"c_open", c_open, NULL, kBI_none},
+    {"c_close", c_close, NULL, kBI_none},
+    // {"c_read", c_read, NULL, kBI_none},
+
+    {"+", primitive_add, NULL, kBI_add},
+    {"-", primitive_sub, NULL, kBI_sub},
+    {"*", primitive_mul, NULL, kBI_mul},
+    {"/", primitive_div, NULL, kBI_div},
+
+    {"=", primitive_eq, NULL, kBI_eq},
+    {"<", primitive_lt, NULL, kBI_lt},
+    {">", primitive_gt, NULL, kBI_gt},
+    {"<=", primitive_le, NULL, kBI_le},
+    {">=", primitive_ge, NULL, kBI_ge},
+    {NULL, NULL, NULL, kBI_none},
+};
+
+// Binds ARGS to the command line arguments left to the script.
+static void env_add_args(object_t env, int argc, const char **argv) {
+  struct s_list_builder ARGS;
+  object_list_builder_init(&ARGS);
+  for (int i = 0; i < argc; i++) {
+    object_new(arg, object_create_string(argv[i]), { //
+      object_list_builder_push(&ARGS, arg);
+    });
+  }
+  object_new(key, object_create_symbol("ARGS"), { //
+    env_add(env, key, ARGS.list);
+  });
+  object_release(ARGS.list);
+}
+
 object_t object_create_env(int argc, const char **argv) {
   object_t env = NULL;
-  object_new(vars, object_list_create(), {
+  object_new(names, object_list_create(), {
     object_new(parent, object_list_create(), {
-      env = make_env(vars, parent);
+      env = make_env(parent, names, 0);
+      env->env.table = table_create();
 
       env_add_constant(env, "nil", kCT_nil);
       env_add_constant(env, "true", kCT_true);
       env_add_constant(env, "false", kCT_nil);
 
-      env_add_primitive(env, "if", primitive_if);
-      env_add_primitive(env, "do", primitive_do);
-      env_add_primitive(env, "let", primitive_let);
-      env_add_primitive(env, "define", primitive_define);
-      env_add_primitive(env, "defun", primitive_defun);
-      env_add_primitive(env, "lambda", primitive_lambda);
-      env_add_primitive(env, "quote", primitive_quote);
-      env_add_primitive(env, "print", primitive_print);
-      env_add_primitive(env, "eval", primitive_eval);
-      env_add_primitive(env, "read", primitive_read);
-
+      for (const struct s_builtin *p = builtins; p->name != NULL; p++)
+        env_add_builtin(env, p);
       env_add_integer(env, "O_RDONLY", O_RDONLY);
-      env_add_primitive(env, "c_open", c_open);
-      env_add_primitive(env, "c_close", c_close);
-      // env_add_primitive(env, "c_read", c_read);
-
-      env_add_primitive(env, "+", primitive_add);
-      env_add_primitive(env, "-", primitive_sub);
-      env_add_primitive(env, "*", primitive_mul);
-      env_add_primitive(env, "/", primitive_div);
-
-      env_add_primitive(env, "=", primitive_eq);
-      env_add_primitive(env, "<", primitive_lt);
-      env_add_primitive(env, ">", primitive_gt);
-      env_add_primitive(env, "<=", primitive_le);
-      env_add_primitive(env, ">=", primitive_ge);
-
-      object_new(ARGS, object_list_create(), {
-        for (int i = 0; i < argc; i++) {
-          object_new(arg, object_create_string(argv[i]), { //
-            object_list_push(&ARGS, arg);
-          });
-        }
-        object_new(key, object_create_symbol("ARGS"), { //
-          env_add(env, key, ARGS);
-        });
-      });
+
+      env_add_args(env, argc, argv);
     });
   });
   return env;
 }
 
+// An image is a copy of the heap reachable from the global frame, laid out
+// so that it can be mapped back and used in place:
+//
+//   header
+//   heap        the objects, each behind a memory header that is never
+//               released, and the arrays of the code objects
+//   relocs      u64 offsets in the heap of the fields holding references
+//   symbols     u64 offsets of the symbols, interned again at load time
+//   primitives  u64 offsets of the primitives, relinked by name
+//   bindings    (key, value) references bound in the global frame
+//
+// A reference is an offset in the heap, or one of the values below for the
+// objects that live outside of it; integers are stored as they are. The
+// global frame itself is not saved: a new one is made at load time, with a
+// table the process owns.
+
+#define IMAGE_MAGIC 0x474D494C53494C43ULL // "CLISLIMG" as a little-endian u64
+#define IMAGE_VERSION 6
+
+#define IMAGE_NULL 0
+#define IMAGE_NIL 2
+#define IMAGE_TRUE 4
+#define IMAGE_GLOBAL 6
+// first offset used in the heap, above the values above
+#define IMAGE_START 8
+
+struct s_image_header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t size;
+  uint64_t relocs;
+  uint64_t symbols;
+  uint64_t primitives;
+  uint64_t bindings;
+  uint64_t padding;
+};
+
+struct s_image {
+  object_t global;
+  char *heap;
+  size_t size;
+  size_t capacity;
+  // objects already laid out and the offsets of their data
+  object_t *objects;
+  uint64_t *offsets;
+  size_t count;
+  size_t slots;
+  // objects laid out but not filled yet
+  object_t *pending;
+  size_t waiting;
+  size_t room;
+  // the sections after the heap
+  struct {
+    uint64_t *data;
+    size_t size;
+    size_t capacity;
+  } relocs, symbols, primitives, bindings;
+};
+
+#define image_push(_array, _value)                                             \
+  do {                                                                         \
+    if ((_array).size == (_array).capacity) {                                  \
+      (_array).capacity = (_array).capacity == 0 ? 64 : (_array).capacity * 2; \
+      (_array).data =                                                          \
+          realloc((_array).data, (_array).capacity * sizeof(uint64_t));        \
+      assert((_array).data != NULL);                                           \
+    }                                                                          \
+    (_array).data[(_array).size++] = (_value);                                 \
+  } while (0)
+
+static size_t object_size(object_t self) {
+  switch (object_type(self)) {
+  case kOT_list:
+    return (sizeof(self->list));
+  case kOT_env:
+    return (sizeof(self->env) + (self->env.count > 1 ? self->env.count - 1 : 0) *
+                                    sizeof(self->env.slots[0]));
+  case kOT_symbol:
+    return (strlen(self->symbol.name) + sizeof(self->symbol));
+  case kOT_string:
+    return (strlen(self->string) + sizeof(self->string));
+  case kOT_primitive:
+    return (sizeof(self->primitive));
+  case kOT_function:
+    return (sizeof(self->function));
+  case kOT_code:
+    return (sizeof(self->code));
+  default:
+    assert(false);
+    return (0);
+  }
+}
+
+static size_t image_alloc(struct s_image *self, size_t size) {
+  size = (size + 7) & ~(size_t)7;
+  if (self->size + size > self->capacity) {
+    while (self->size + size > self->capacity)
+      self->capacity = self->capacity == 0 ? 64 * 1024 : self->capacity * 2;
+    self->heap = realloc(self->heap, self->capacity);
+    assert(self->heap != NULL);
+  }
+  memset(self->heap + self->size, 0, size);
+  self->size += size;
+  return (self->size - size);
+}
+
+static void image_grow(struct s_image *self) {
+  size_t slots = self->slots == 0 ? 1024 : self->slots * 2;
+  object_t *objects = calloc(slots, sizeof(*objects));
+  uint64_t *offsets = calloc(slots, sizeof(*offsets));
+  assert(objects != NULL && offsets != NULL);
+
+  for (size_t i = 0; i < self->slots; i++) {
+    if (self->objects[i] == NULL)
+      continue;
+    size_t idx = ((uintptr_t)self->objects[i] >> 3) & (slots - 1);
+    while (objects[idx] != NULL)
+      idx = (idx + 1) & (slots - 1);
+    objects[idx] = self->objects[i];
+    offsets[idx] = self->offsets[i];
+  }
+
+  free(self->objects);
+  free(self->offsets);
+  self->objects = objects;
+  self->offsets = offsets;
+  self->slots = slots;
+}
+
+// The reference to `object` in the image, laying it out on first use.
+static uint64_t image_ref(struct s_image *self, object_t object) {
+  if (object == NULL)
+    return (IMAGE_NULL);
+  if (object_is_fixnum(object))
+    return ((uintptr_t)object);
+  if (object == &object_nil)
+    return (IMAGE_NIL);
+  if (object == &object_true)
+    return (IMAGE_TRUE);
+  if (object == self->global)
+    return (IMAGE_GLOBAL);
+
+  if (2 * (self->count + 1) > self->slots)
+    image_grow(self);
+  size_t idx = ((uintptr_t)object >> 3) & (self->slots - 1);
+  for (; self->objects[idx] != NULL; idx = (idx + 1) & (self->slots - 1))
+    if (self->objects[idx] == object)
+      return (self->offsets[idx]);
+
+  // the header ends the word before the data, which stays aligned
+  size_t block = image_alloc(self, sizeof(uint64_t) + object_size(object));
+  size_t data = block + sizeof(uint64_t);
+  memory_place(self->heap + data - memory_overhead(), object_type(object));
+  self->count += 1;
+  self->objects[idx] = object;
+  self->offsets[idx] = data;
+
+  if (self->waiting == self->room) {
+    self->room = self->room == 0 ? 256 : self->room * 2;
+    self->pending = realloc(self->pending, self->room * sizeof(object_t));
+    assert(self->pending != NULL);
+  }
+  self->pending[self->waiting++] = object;
+  if (object_type(object) == kOT_symbol)
+    image_push(self->symbols, self->offsets[idx]);
+  return (self->offsets[idx]);
+}
+
+// Stores at `at` in the heap a reference, remembered to be relocated.
+static void image_store(struct s_image *self, size_t at, uint64_t value) {
+  memcpy(self->heap + at, &value, sizeof(value));
+  if (value != IMAGE_NULL && (value & 1) == 0)
+    image_push(self->relocs, at);
+}
+
+#define image_field(_self, _at, _field, _object)                               \
+  image_store((_self), (_at) + offsetof(struct s_object, _field),              \
+              image_ref((_self), (_object)))
+
+static void image_fill(struct s_image *self, object_t object, size_t at) {
+  memcpy(self->heap + at, object, object_size(object));
+  switch (object_type(object)) {
+  case kOT_list:
+    image_field(self, at, list.head, object->list.head);
+    image_field(self, at, list.tail, object->list.tail);
+    break;
+  case kOT_env:
+    assert(object->env.table == NULL);
+    image_field(self, at, env.vars, object->env.vars);
+    image_field(self, at, env.parent, object->env.parent);
+    image_field(self, at, env.names, object->env.names);
+    for (size_t i = 0; i < object->env.count; i++)
+      image_field(self, at, env.slots[i], object->env.slots[i]);
+    break;
+  case kOT_symbol:
+  case kOT_string:
+    break;
+  case kOT_primitive: {
+    const struct s_builtin *p = builtins;
+    while (p->function != object->primitive.function ||
+           p->special != object->primitive.special)
+      p++;
+    assert(p->name != NULL);
+    // the name stands for the function until the image is loaded
+    size_t name = image_alloc(self, strlen(p->name) + 1);
+    strcpy(self->heap + name, p->name);
+    uint64_t value = name;
+    memcpy(self->heap + at + offsetof(struct s_object, primitive.function),
+           &value, sizeof(value));
+    memset(self->heap + at + offsetof(struct s_object, primitive.special), 0,
+           sizeof(special_t *));
+    image_push(self->primitives, at);
+    break;
+  }
+  case kOT_function:
+    image_field(self, at, function.params, object->function.params);
+    image_field(self, at, function.body, object->function.body);
+    image_field(self, at, function.env, object->function.env);
+    image_field(self, at, function.code, object->function.code);
+    image_field(self, at, function.name, object->function.name);
+    break;
+  case kOT_code: {
+    size_t ops = image_alloc(self, object->code.size * sizeof(uint32_t));
+    memcpy(self->heap + ops, object->code.ops,
+           object->code.size * sizeof(uint32_t));
+    image_store(self, at + offsetof(struct s_object, code.ops), ops);
+
+    size_t constants = image_alloc(self, object->code.count * sizeof(object_t));
+    for (size_t i = 0; i < object->code.count; i++)
+      image_store(self, constants + i * sizeof(object_t),
+                  image_ref(self, object->code.constants[i]));
+    image_store(self, at + offsetof(struct s_object, code.constants),
+                constants);
+
+    // empty caches, as the bindings are made again at load time
+    size_t caches =
+        image_alloc(self, object->code.lookups * sizeof(struct s_cache));
+    image_store(self, at + offsetof(struct s_object, code.caches), caches);
+
+    // the process loading the image starts with no builtin replaced
+    size_t builtins =
+        object->code.builtins == object_builtins_version ? 0 : SIZE_MAX;
+    memcpy(self->heap + at + offsetof(struct s_object, code.builtins),
+           &builtins, sizeof(builtins));
+    break;
+  }
+  default:
+    assert(false);
+    break;
+  }
+}
+
+static bool image_write(FILE *fp, const void *data, size_t size) {
+  return size == 0 || fwrite(data, size, 1, fp) == 1;
+}
+
+bool object_dump_image(object_t env, const char *path) {
+  assert(env != NULL && env->env.table != NULL);
+  struct s_image self = {.global = env};
+  image_alloc(&self, IMAGE_START);
+
+  struct s_table *table = env->env.table;
+  for (size_t i = 0; i < table->capacity; i++) {
+    if (table->bindings[i].key == NULL)
+      continue;
+    image_push(self.bindings, image_ref(&self, table->bindings[i].key));
+    image_push(self.bindings, image_ref(&self, table->bindings[i].value));
+  }
+  for (size_t i = 0; i < self.waiting; i++) {
+    object_t object = self.pending[i];
+    size_t idx = ((uintptr_t)object >> 3) & (self.slots - 1);
+    while (self.objects[idx] != object)
+      idx = (idx + 1) & (self.slots - 1);
+    image_fill(&self, object, self.offsets[idx]);
+  }
+
+  struct s_image_header header = {
+      .magic = IMAGE_MAGIC,
+      .version = IMAGE_VERSION,
+      .size = self.size,
+      .relocs = self.relocs.size,
+      .symbols = self.symbols.size,
+      .primitives = self.primitives.size,
+      .bindings = self.bindings.size / 2,
+  };
+
+  FILE *fp = fopen(path, "wb");
+  bool saved = fp != NULL;
+  if (saved) {
+    saved = image_write(fp, &header, sizeof(header)) &&
+            image_write(fp, self.heap, self.size) &&
+            image_write(fp, self.relocs.data, self.relocs.size * 8) &&
+            image_write(fp, self.symbols.data, self.symbols.size * 8) &&
+            image_write(fp, self.primitives.data, self.primitives.size * 8) &&
+            image_write(fp, self.bindings.data, self.bindings.size * 8);
+    saved = fclose(fp) == 0 && saved;
+  }
+
+  free(self.heap);
+  free(self.objects);
+  free(self.offsets);
+  free(self.pending);
+  free(self.relocs.data);
+  free(self.symbols.data);
+  free(self.primitives.data);
+  free(self.bindings.data);
+  return (saved);
+}
+
+// What the references of an image are decoded against. The symbols of the
+// image are in increasing offsets, each with the symbol interned for it.
+// Some references are those of the arrays of the code objects rather than of
+// objects, so that references are told to be symbols by their offset alone.
+struct s_image_map {
+  char *heap;
+  object_t global;
+  const uint64_t *symbols;
+  object_t *interned;
+  uint64_t count;
+};
+
+static object_t image_object(const struct s_image_map *map, uint64_t value) {
+  uint64_t low = 0, high = map->count;
+  while (low < high) {
+    uint64_t middle = low + (high - low) / 2;
+    if (map->symbols[middle] < value)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  if (low < map->count && map->symbols[low] == value)
+    return (map->interned[low]);
+  return ((object_t)(map->heap + value));
+}
+
+static object_t image_decode(const struct s_image_map *map, uint64_t value) {
+  switch (value) {
+  case IMAGE_NULL:
+    return (NULL);
+  case IMAGE_NIL:
+    return (&object_nil);
+  case IMAGE_TRUE:
+    return (&object_true);
+  case IMAGE_GLOBAL:
+    return (map->global);
+  default:
+    return (value & 1) != 0 ? (object_t)(uintptr_t)value
+                            : image_object(map, value);
+  }
+}
+
+// The image is mapped privately: the pages the process writes to, for the
+// relocations and the reference counts, are copied on write, the others stay
+// shared with every process using the same image. The mapping is never
+// released, as the objects in it live as long as the process. Symbols
+// interned before the image was loaded, such as those of a cache, stand for
+// the symbols of the image with the same name.
+object_t object_load_image(const char *path, int argc, const char **argv) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return (NULL);
+
+  struct stat st;
+  char *addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct s_image_header))
+    addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return (NULL);
+
+  const struct s_image_header *header = (const void *)addr;
+  uint64_t words = header->relocs + header->symbols + header->primitives +
+                   header->bindings * 2;
+  if (header->magic != IMAGE_MAGIC || header->version != IMAGE_VERSION ||
+      (uint64_t)st.st_size != sizeof(*header) + header->size + words * 8) {
+    munmap(addr, st.st_size);
+    return (NULL);
+  }
+
+  char *heap = addr + sizeof(*header);
+  const uint64_t *relocs = (const uint64_t *)(heap + header->size);
+  const uint64_t *symbols = relocs + header->relocs;
+  const uint64_t *primitives = symbols + header->symbols;
+  const uint64_t *bindings = primitives + header->primitives;
+
+  object_t env = NULL;
+  object_new(names, object_list_create(), {
+    object_new(parent, object_list_create(), {
+      env = make_env(parent, names, 0);
+      env->env.table = table_create();
+    });
+  });
+
+  struct s_image_map map = {heap, env, symbols, NULL, header->symbols};
+  map.interned = malloc((header->symbols + 1) * sizeof(object_t));
+  assert(map.interned != NULL);
+  for (uint64_t i = 0; i < header->symbols; i++)
+    map.interned[i] = symbol_adopt((object_t)(heap + symbols[i]));
+
+  for (uint64_t i = 0; i < header->relocs; i++) {
+    uint64_t value = 0;
+    memcpy(&value, heap + relocs[i], sizeof(value));
+    object_t object = image_decode(&map, value);
+    memcpy(heap + relocs[i], &object, sizeof(object));
+  }
+
+  for (uint64_t i = 0; i < header->primitives; i++) {
+    object_t object = (object_t)(heap + primitives[i]);
+    const char *name = heap + (uintptr_t)object->primitive.function;
+    const struct s_builtin *p = builtins;
+    while (p->name != NULL && strcmp(p->name, name) != 0)
+      p++;
+    assert(p->name != NULL);
+    object->primitive.function = p->function;
+    object->primitive.special = p->special;
+  }
+
+  for (uint64_t i = 0; i < header->bindings; i++)
+    env_add(env, image_decode(&map, bindings[2 * i]),
+            image_decode(&map, bindings[2 * i + 1]));
+  free(map.interned);
+
+  env_add_args(env, argc, argv);
+  return (env);
+}
+
 void object_print(object_t self) {
   assert(self != NULL);
-  switch (self->type) {
+  switch (object_type(self)) {
   case kOT_function:
     printf("<function>");
     break;
   case kOT_primitive:
     printf("<primitive>");
     break;
+  case kOT_code:
+    printf("<code>");
+    break;
   case kOT_symbol:
-    printf("%s", self->symbol);
+    printf("%s", self->symbol.name);
     break;
   case kOT_string:
     printf("%s", self->string);
     break;
   case kOT_integer:
-    printf("%d", self->integer);
+    printf("%d", object_integer(self));
     break;
   case kOT_list:
     printf("(");
@@ -652,7 +1557,7 @@ void object_print(object_t self) {
     }
     break;
   default:
-    printf("ERROR: type = %d\n", self->type);
+    printf("ERROR: type = %d\n", object_type(self));
     assert(false);
     break;
   }
@@ -660,9 +1565,28 @@ void object_print(object_t self) {
 
 void object_dump(object_t self) {
   assert(self != NULL);
-  switch (self->type) {
+  switch (object_type(self)) {
   case kOT_env:
     printf("ENV[VARS[");
+    for (size_t i = 0; self->env.table && i < self->env.table->capacity; i++) {
+      struct s_binding *binding = &self->env.table->bindings[i];
+      if (binding->key == NULL)
+        continue;
+      printf("(");
+      object_dump(binding->key);
+      printf(",");
+      object_dump(binding->value);
+      printf(")");
+    }
+    object_t names = self->env.names;
+    for (size_t i = 0; i < self->env.count; i++, names = names->list.tail) {
+      printf("(");
+      object_dump(names->list.head);
+      printf(",");
+      if (self->env.slots[i] != NULL)
+        object_dump(self->env.slots[i]);
+      printf(")");
+    }
     for (object_t p = self->env.vars; !object_list_is_empty(p);
          p = p->list.tail) {
       printf("(");
@@ -681,14 +1605,17 @@ void object_dump(object_t self) {
   case kOT_primitive:
     printf("PRIMITIVE");
     break;
+  case kOT_code:
+    printf("CODE[%zu]", self->code.size);
+    break;
   case kOT_string:
     printf("STRING[%s]", self->string);
     break;
   case kOT_symbol:
-    printf("SYMBOL[%s]", self->symbol);
+    printf("SYMBOL[%s]", self->symbol.name);
     break;
   case kOT_integer:
-    printf("INTEGER[%d]", self->integer);
+    printf("INTEGER[%d]", object_integer(self));
     break;
   case kOT_list:
     printf("LIST[");
@@ -717,41 +1644,163 @@ void object_dump(object_t self) {
   }
 }
 
-object_t object_apply(object_t env, object_t func, object_t args) {
-  assert(env != NULL);
-  assert(env->type == kOT_env);
-  assert(func != NULL);
-  if (func->type != kOT_primitive && func->type != kOT_function) {
-    object_dump(func);
-    printf("\n");
-    // object_dump(args);
-    // printf("\n");
-    assert(false);
+// When set, forms are evaluated by walking the cons tree instead of being
+// compiled to bytecode first.
+static bool tree_walk = false;
+
+void object_use_tree_walk(bool enabled) { //
+  tree_walk = enabled;
+}
+
+// The arguments of the primitives called by the evaluator are evaluated onto
+// this stack and passed to them in place, so that a call does not allocate.
+#define VALUES_SIZE (1 << 16)
+static object_t values[VALUES_SIZE];
+static size_t values_top = 0;
+
+// where object_error goes back to, set by the outermost object_run
+static jmp_buf *recover = NULL;
+
+// The evaluator recurses on the C stack: past `stack_limit` bytes below the
+// frame of the outermost object_run, it reports a stack overflow rather than
+// running into the end of the stack.
+static char *stack_base = NULL;
+static size_t stack_limit = 0;
+
+static void stack_check(void) {
+  char *here = __builtin_frame_address(0);
+  if (stack_base != NULL && (size_t)(stack_base - here) > stack_limit)
+    object_error("stack overflow");
+}
+
+void object_error(const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  printf("ERROR: ");
+  vprintf(format, ap);
+  printf("\n");
+  va_end(ap);
+  profile_backtrace(stderr);
+  if (recover == NULL)
+    exit(1);
+  owned_release();
+  longjmp(*recover, 1);
+}
+
+static object_t run(object_t env, object_t object) {
+  if (tree_walk == true)
+    return object_eval(env, object);
+
+  object_t code = object_compile(env, object);
+  size_t mark = own(&code);
+  object_t result = object_execute(env, code);
+  disown(mark);
+  object_release(code);
+  return (result);
+}
+
+// The references held by the C frames an error unwinds are released: those
+// of the tree-walker by object_error, those on the value stacks here.
+object_t object_run(object_t env, object_t object) {
+  if (recover != NULL)
+    return run(env, object);
+
+  // compiled before the recovery point, to be released after an error too
+  object_t code = tree_walk ? NULL : object_compile(env, object);
+  object_t result = NULL;
+  jmp_buf here;
+  if (stack_limit == 0) {
+    struct rlimit limit;
+    bool bounded = getrlimit(RLIMIT_STACK, &limit) == 0 &&
+                   limit.rlim_cur != RLIM_INFINITY;
+    // what the primitives and the VM may still need below the limit
+    stack_limit = (bounded ? limit.rlim_cur : 8 << 20) / 4 * 3;
+  }
+  if (setjmp(here) == 0) {
+    recover = &here;
+    stack_base = __builtin_frame_address(0);
+    result = code != NULL ? object_execute(env, code) : object_eval(env, object);
+  } else {
+    result = NULL;
+    while (values_top > 0)
+      object_release(values[--values_top]);
+    object_vm_unwind();
+    profile_unwind(0);
   }
+  recover = NULL;
+  stack_base = NULL;
+  if (code != NULL)
+    object_release(code);
+  object_compile_flush();
+  return (result);
+}
+
+// Applies `func` to the unevaluated `args` like the steps above: the body of a
+// tree-walked function is left in `*tail`, to be evaluated in its own frame.
+// That frame replaces the profile frames above `mark`, those of the function
+// making a tail call.
+static object_t apply(object_t *env, object_t func, object_t args,
+                      object_t *tail, size_t mark) {
+  assert(*env != NULL);
+  assert(object_type(*env) == kOT_env);
+  assert(func != NULL);
+  if (object_type(func) != kOT_primitive && object_type(func) != kOT_function)
+    object_error("not a function");
 
   assert(args != NULL);
 
-  switch (func->type) {
+  switch (object_type(func)) {
   case kOT_primitive: {
-    return func->primitive(env, args);
+    switch (func->primitive.builtin) {
+    case kBI_do:
+      return step_do(env, args, tail);
+    case kBI_if:
+      return step_if(env, args, tail);
+    case kBI_let:
+      return step_let(env, args, tail);
+    default:
+      break;
+    }
+    if (func->primitive.special != NULL)
+      return func->primitive.special(*env, args);
+
+    object_t *argv = values + values_top;
+    size_t argc = 0;
+    for (; !object_list_is_empty(args); args = args->list.tail, argc++) {
+      if (values_top == VALUES_SIZE)
+        object_error("stack overflow");
+      object_t value = object_eval(*env, args->list.head);
+      values[values_top++] = value != NULL ? value : object_list_create();
+    }
+    object_t result = func->primitive.function(argc, argv);
+    for (; argc > 0; argc--)
+      object_release(values[--values_top]);
+    return (result);
   }
   case kOT_function: {
     object_t result = NULL, params = func->function.params;
-    assert(object_list_length(params) == object_list_length(args));
-    object_new(empty, object_list_create(), {
-      object_new(new_env, make_env(empty, func->function.env), {
-        object_new(head, object_eval_list(env, args), {
-          object_t values = head;
-          while (object_list_is_empty(params) == false) {
-            env_add(new_env, params->list.head, values->list.head);
-            params = params->list.tail;
-            values = values->list.tail;
-          }
-        });
-        result = primitive_do(new_env, func->function.body);
-      });
-    });
-    return result;
+    size_t count = object_list_length(params), argc = object_list_length(args);
+    if (argc != count)
+      object_error("wrong number of arguments: %zu for %zu", argc, count);
+    object_t new_env = make_env(func->function.env, params, count);
+    size_t owner = own(&new_env);
+    for (size_t i = 0; i < count; i++, args = args->list.tail)
+      new_env->env.slots[i] = object_eval(*env, args->list.head);
+    if (tree_walk == false) {
+      mark = profile_mark();
+      profile_push(func);
+      result = object_execute(new_env, object_compile_function(func));
+      profile_unwind(mark);
+      disown(owner);
+      object_release(new_env);
+      return (result);
+    }
+    profile_unwind(mark);
+    profile_push(func);
+    *env = new_env;
+    result = step_do(env, func->function.body, tail);
+    disown(owner);
+    return (result);
   }
   default:
     printf("ERROR: ");
@@ -764,40 +1813,91 @@ object_t object_apply(object_t env, object_t func, object_t args) {
   return (NULL);
 }
 
+object_t object_apply(object_t env, object_t func, object_t args) {
+  object_t next = env, tail = NULL;
+  size_t mark = profile_mark();
+  object_t result = apply(&next, func, args, &tail, mark);
+  result = step_finish(env, next, result, tail);
+  profile_unwind(mark);
+  return (result);
+}
+
+// Forms in tail position of if, do, let and function bodies are evaluated by
+// looping here, so tail calls run in constant C stack. `frame` and `form` hold
+// the references that keep the current env and form alive meanwhile.
 object_t object_eval(object_t env, object_t object) {
-  assert(env != NULL);
-  assert(object != NULL);
+  object_t frame = NULL, form = NULL, func = NULL, result = NULL;
+  size_t mark = profile_mark();
+
+  stack_check();
+  size_t owner = own(&func);
+  for (;;) {
+    assert(env != NULL);
+    assert(object != NULL);
+
+    switch (object_type(object)) {
+    case kOT_symbol: {
+      const char *name = object->symbol.name;
+      result = env_find(env, object);
+      if (result == NULL)
+        object_error("unbound name: %s", name);
+      result = object_retain(result);
+      break;
+    }
+    case kOT_integer:
+    case kOT_string:
+    case kOT_constant:
+      result = object_retain(object);
+      break;
+    case kOT_list: {
+      object_t next = env, tail = NULL;
+      func = object_eval(env, object->list.head);
+      if (func != NULL) {
+        result = apply(&next, func, object->list.tail, &tail, mark);
+        if (tail != NULL)
+          object_retain(tail);
+        object_release(func);
+        func = NULL;
+      }
+      if (tail == NULL) {
+        if (next != env)
+          object_release(next);
+        break;
+      }
 
-  switch (object->type) {
-  case kOT_symbol: {
-    const char *name = object->symbol;
-    object = env_find(env, object);
-    if (object == NULL) {
-      printf("name: %s\n", name);
+      // registered once the first tail call gives them references
+      if (form == NULL) {
+        own(&form);
+        own(&frame);
+      } else {
+        object_release(form);
+      }
+      object = form = tail;
+      if (next != env) {
+        if (frame != NULL)
+          object_release(frame);
+        env = frame = next;
+      }
+      continue;
+    }
+    default:
       assert(false);
+      break;
     }
-    return memory_retain(object);
-  }
-  case kOT_integer:
-  case kOT_string:
-  case kOT_constant:
-    return memory_retain(object);
-  case kOT_list: {
-    object_t result = NULL;
-    object_new(func, object_eval(env, object->list.head),
-               { result = object_apply(env, func, object->list.tail); });
-    return result;
-  }
-  default:
-    assert(false);
     break;
   }
 
-  return (NULL);
+  disown(owner);
+  if (form != NULL)
+    object_release(form);
+  if (frame != NULL)
+    object_release(frame);
+  profile_unwind(mark);
+  return (result);
 }
 
 void object_delete(void *ptr) {
   object_t *object_ptr = (object_t *)ptr;
   object_t object = *((object_t *)object_ptr);
-  *object_ptr = memory_release(object);
+  *object_ptr = object_release(object);
 }
\ No newline at end of file
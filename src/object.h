@@ -1,8 +1,12 @@
 #ifndef __OBJECT_H__
 #define __OBJECT_H__
 
+#include "memory.h"
+
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 typedef enum
 {
@@ -14,6 +18,7 @@ typedef enum
     kOT_env = 6,
     kOT_primitive = 7,
     kOT_function = 8,
+    kOT_code = 9,
 } object_type_t;
 
 typedef enum
@@ -22,47 +27,116 @@ typedef enum
     kCT_true,
 } constant_type_t;
 
+// Builtins the compiler is allowed to open-code when their name is bound to
+// the original primitive at compile time.
+typedef enum
+{
+    kBI_none,
+    kBI_quote,
+    kBI_if,
+    kBI_do,
+    kBI_let,
+    kBI_define,
+    kBI_defun,
+    kBI_lambda,
+    kBI_add,
+    kBI_sub,
+    kBI_mul,
+    kBI_div,
+    kBI_eq,
+    kBI_lt,
+    kBI_gt,
+    kBI_le,
+    kBI_ge,
+} builtin_t;
+
 typedef struct s_object *object_t;
 
-typedef object_t primitive_t(object_t env, object_t args);
+struct s_table;
 
+// Value a lookup instruction found in the global frame, valid while no
+// definition was made since, that is while `version` is object_version.
+struct s_cache
+{
+    size_t version;
+    struct s_object *value;
+};
+
+// Primitives receive their arguments already evaluated, borrowed from the
+// value stack of the caller; special forms receive the unevaluated forms and
+// the environment to evaluate them in.
+typedef object_t primitive_t(size_t argc, object_t *argv);
+typedef object_t special_t(object_t env, object_t args);
+
+// The type of an object is the kind of its block, read from its header.
 struct s_object
 {
-    object_type_t type;
     union
     {
-        // _
-        char _;
         // constant
         constant_type_t constant;
-        // integer
-        int integer;
         // list
         struct
         {
             struct s_object *head;
             struct s_object *tail;
-            struct s_object *last;
         } list;
         // env
         struct
         {
+            // (symbol . value) pairs defined at run time without a slot
             struct s_object *vars;
             struct s_object *parent;
+            // bindings of the global frame, NULL for the other frames
+            struct s_table *table;
+            // symbols naming the slots, in slot order
+            struct s_object *names;
+            size_t count;
+            // NULL until the slot is bound
+            struct s_object *slots[1];
         } env;
         // symbol
-        char symbol[1];
+        struct
+        {
+            size_t hash;
+            // set once bound in a frame other than the global one, after
+            // which lookups of the symbol are never cached
+            bool local;
+            char name[1];
+        } symbol;
         // string
         char string[1];
         // primitive
-        primitive_t *primitive;
+        struct
+        {
+            // exactly one of function and special is set
+            primitive_t *function;
+            special_t *special;
+            builtin_t builtin;
+        } primitive;
         // function
         struct
         {
             struct s_object *params;
             struct s_object *body;
             struct s_object *env;
+            struct s_object *code;
+            // symbol it was first defined as, NULL while anonymous
+            struct s_object *name;
         } function;
+        // code
+        struct
+        {
+            uint32_t *ops;
+            size_t size;
+            struct s_object **constants;
+            size_t count;
+            // one per kOP_lookup
+            struct s_cache *caches;
+            size_t lookups;
+            // object_builtins_version the builtins were open-coded under
+            size_t builtins;
+        } code;
     };
 };
 
@@ -71,21 +145,118 @@ extern "C"
 {
 #endif
 
+    // Integers are immediate: they are stored in the object pointer itself,
+    // tagged by its lowest bit, and are never allocated nor reference counted.
+    static inline bool object_is_fixnum(object_t self)
+    {
+        return (((uintptr_t)self) & 1) != 0;
+    }
+
+    static inline object_type_t object_type(object_t self)
+    {
+        return object_is_fixnum(self) ? kOT_integer
+                                      : (object_type_t)memory_kind(self);
+    }
+
+    static inline int object_integer(object_t self)
+    {
+        return (int)(((intptr_t)self) >> 1);
+    }
+
+    // nil and true are immortal singletons, compared by identity. They are
+    // statically allocated right after a header that holds their type.
+    struct s_object_static
+    {
+        uint32_t padding;
+        uint32_t header;
+        struct s_object object;
+    };
+
+    extern struct s_object_static object_static_nil;
+    extern struct s_object_static object_static_true;
+#define object_nil (object_static_nil.object)
+#define object_true (object_static_true.object)
+
+    static inline bool object_is_immortal(object_t self)
+    {
+        return object_is_fixnum(self) || self == &object_nil ||
+               self == &object_true;
+    }
+
+    static inline object_t object_retain(object_t self)
+    {
+        return object_is_immortal(self) ? self : memory_retain(self);
+    }
+
+    static inline object_t object_release(object_t self)
+    {
+        return object_is_immortal(self) ? self : memory_release(self);
+    }
+
+    static inline bool object_list_is_empty(object_t self)
+    {
+        return self == &object_nil;
+    }
+
     // string
     object_t object_create_string(const char *name);
+    object_t object_create_string_slice(const char *name, size_t length);
     // symbol
     object_t object_create_symbol(const char *name);
+    object_t object_create_symbol_slice(const char *name, size_t length);
     // integer
     object_t object_create_integer(int value);
     // list
     object_t object_list_create();
     size_t object_list_length(object_t list);
-    void object_list_push(object_t *list_ptr, object_t object);
-    bool object_list_is_empty(object_t object);
+
+    // Builds a list from its first element to its last: `list` is the list
+    // built so far, owned by the caller once done, and `last` its last cell.
+    struct s_list_builder
+    {
+        object_t list;
+        object_t last;
+    };
+
+    void object_list_builder_init(struct s_list_builder *self);
+    void object_list_builder_push(struct s_list_builder *self, object_t object);
+    // constant
+    object_t object_create_boolean(bool value);
+    // function
+    object_t object_create_function(object_t params, object_t body,
+                                    object_t env);
+    // code
+    object_t object_create_code(uint32_t *ops, size_t size,
+                                object_t *constants, size_t count,
+                                size_t lookups);
     // env
     object_t object_create_env(int argc, const char **argv);
+    // counters of the allocator, by object type
+    void object_dump_memory_stats(FILE *fp);
+    // image
+    bool object_dump_image(object_t env, const char *path);
+    object_t object_load_image(const char *path, int argc, const char **argv);
+    object_t object_create_frame(object_t parent, object_t names,
+                                 size_t count);
+    object_t object_env_find(object_t env, object_t symbol);
+    // Same, filling `cache` when the value was found in the global frame.
+    object_t object_env_lookup(object_t env, object_t symbol,
+                               struct s_cache *cache);
+    // bumped by every definition, which invalidates all the caches
+    extern size_t object_version;
+    // bumped by a definition replacing one of the builtins, after which the
+    // functions compiled before it are compiled again when next called
+    extern size_t object_builtins_version;
+    void object_env_add(object_t env, object_t symbol, object_t value);
     // eval
     object_t object_eval(object_t env, object_t object);
+    object_t object_apply(object_t env, object_t func, object_t args);
+    object_t object_run(object_t env, object_t object);
+    // Reports an error in the form being run and abandons it: the outermost
+    // object_run unwinds the stacks of the evaluators and returns NULL.
+    void object_error(const char *format, ...)
+        __attribute__((noreturn, format(printf, 1, 2)));
+    void object_use_tree_walk(bool enabled);
 
     void object_print(object_t self);
     void object_dump(object_t self);
@@ -0,0 +1,488 @@
+#include "object_compile.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// A frame the compiled code runs in: the frame of the function itself or one
+// opened by a let.
+struct s_scope {
+  // symbols naming the slots of the frame, in slot order
+  object_t names;
+};
+
+struct s_compiler {
+  // compiler of the enclosing function, whose frames the closure captures
+  struct s_compiler *outer;
+  // environment the code will run in, used to recognise builtins
+  object_t env;
+  // bytecode
+  uint32_t *ops;
+  size_t size;
+  size_t capacity;
+  // constants pool, and an open-addressing index on it by identity, holding
+  // the position of each constant plus one
+  object_t *constants;
+  size_t count;
+  size_t room;
+  uint32_t *index;
+  size_t buckets;
+  // frames opened by the code being compiled, innermost last
+  struct s_scope *scopes;
+  size_t depth;
+  size_t levels;
+  // names defined at run time somewhere in the code: those may shadow a slot
+  // from a frame that does not have one for them, so they are always looked
+  // up by name
+  object_t *defined;
+  size_t defines;
+  size_t slots;
+  // kOP_lookup instructions emitted, each with a cache of its own
+  size_t lookups;
+};
+
+typedef enum {
+  kRS_global, // not bound by any enclosing frame
+  kRS_slot,   // found at a (depth, slot) address
+  kRS_name,   // local, but must be looked up by name
+} resolution_t;
+
+static size_t emit(struct s_compiler *self, uint32_t word) {
+  if (self->size == self->capacity) {
+    self->capacity = self->capacity == 0 ? 32 : self->capacity * 2;
+    self->ops = realloc(self->ops, self->capacity * sizeof(*self->ops));
+    assert(self->ops != NULL);
+  }
+  self->ops[self->size] = word;
+  return (self->size++);
+}
+
+static void patch(struct s_compiler *self, size_t at) {
+  assert(at < self->size);
+  self->ops[at] = self->size;
+}
+
+static size_t bucket_of(struct s_compiler *self, object_t object) {
+  size_t idx = ((uintptr_t)object >> 3) & (self->buckets - 1);
+  while (self->index[idx] != 0 &&
+         self->constants[self->index[idx] - 1] != object)
+    idx = (idx + 1) & (self->buckets - 1);
+  return (idx);
+}
+
+static void index_grow(struct s_compiler *self) {
+  free(self->index);
+  self->buckets = self->buckets == 0 ? 16 : self->buckets * 2;
+  self->index = calloc(self->buckets, sizeof(*self->index));
+  assert(self->index != NULL);
+  for (size_t i = 0; i < self->count; i++)
+    self->index[bucket_of(self, self->constants[i])] = i + 1;
+}
+
+static uint32_t constant(struct s_compiler *self, object_t object) {
+  if (2 * (self->count + 1) > self->buckets)
+    index_grow(self);
+  size_t idx = bucket_of(self, object);
+  if (self->index[idx] != 0)
+    return (self->index[idx] - 1);
+  self->index[idx] = self->count + 1;
+
+  if (self->count == self->room) {
+    self->room = self->room == 0 ? 8 : self->room * 2;
+    self->constants =
+        realloc(self->constants, self->room * sizeof(*self->constants));
+    assert(self->constants != NULL);
+  }
+  self->constants[self->count] = object_retain(object);
+  return (self->count++);
+}
+
+static void scope_enter(struct s_compiler *self, object_t names) {
+  if (self->depth == self->levels) {
+    self->levels = self->levels == 0 ? 4 : self->levels * 2;
+    self->scopes = realloc(self->scopes, self->levels * sizeof(*self->scopes));
+    assert(self->scopes != NULL);
+  }
+  self->scopes[self->depth++].names = names;
+}
+
+static void scope_leave(struct s_compiler *self) {
+  assert(self->depth > 0);
+  self->depth -= 1;
+}
+
+static void define(struct s_compiler *self, object_t name) {
+  assert(object_type(name) == kOT_symbol);
+  for (size_t i = 0; i < self->defines; i++)
+    if (self->defined[i] == name)
+      return;
+  if (self->defines == self->slots) {
+    self->slots = self->slots == 0 ? 8 : self->slots * 2;
+    self->defined =
+        realloc(self->defined, self->slots * sizeof(*self->defined));
+    assert(self->defined != NULL);
+  }
+  self->defined[self->defines++] = name;
+}
+
+static bool is_defined(struct s_compiler *self, object_t name) {
+  for (size_t i = 0; i < self->defines; i++)
+    if (self->defined[i] == name)
+      return (true);
+  return (false);
+}
+
+static bool slot_of(object_t names, object_t name, uint32_t *slot) {
+  uint32_t idx = 0;
+  for (; !object_list_is_empty(names); names = names->list.tail, idx++) {
+    if (names->list.head == name) {
+      *slot = idx;
+      return (true);
+    }
+  }
+  return (false);
+}
+
+static bool is_bound_at_runtime(object_t env, object_t name) {
+  for (object_t p = env->env.vars; !object_list_is_empty(p); p = p->list.tail)
+    if (p->list.head->list.head == name)
+      return (true);
+  return (false);
+}
+
+// Finds where the variable `name` lives: first in the frames opened by the
+// code being compiled and by the functions enclosing it, then in the frames
+// that already exist at run time below them, up to the global frame.
+static resolution_t resolve(struct s_compiler *self, object_t name,
+                            uint32_t *depth, uint32_t *slot) {
+  *depth = 0;
+  for (struct s_compiler *c = self;; c = c->outer) {
+    if (is_defined(c, name))
+      return (kRS_name);
+    for (size_t i = c->depth; i > 0; i--, *depth += 1)
+      if (slot_of(c->scopes[i - 1].names, name, slot))
+        return (kRS_slot);
+    if (c->outer == NULL) {
+      for (object_t env = c->env;
+           !object_list_is_empty(env) && env->env.table == NULL;
+           env = env->env.parent, *depth += 1) {
+        if (is_bound_at_runtime(env, name))
+          return (kRS_name);
+        if (slot_of(env->env.names, name, slot))
+          return (kRS_slot);
+      }
+      return (kRS_global);
+    }
+  }
+}
+
+// A form can be open-coded only when its head names, at compile time, one of
+// the original builtins and is not shadowed by a local binding.
+static builtin_t builtin(struct s_compiler *self, object_t head) {
+  uint32_t depth, slot;
+  if (object_type(head) != kOT_symbol ||
+      resolve(self, head, &depth, &slot) != kRS_global)
+    return (kBI_none);
+  object_t value = object_env_find(self->env, head);
+  if (value == NULL || object_type(value) != kOT_primitive)
+    return (kBI_none);
+  return (value->primitive.builtin);
+}
+
+// Collects the names that `define` and `defun` forms bind anywhere in `form`.
+static void scan(struct s_compiler *self, object_t form) {
+  if (object_type(form) != kOT_list)
+    return;
+
+  object_t head = form->list.head, args = form->list.tail;
+  if (object_type(head) == kOT_symbol) {
+    object_t value = object_env_find(self->env, head);
+    if (value != NULL && object_type(value) == kOT_primitive) {
+      switch (value->primitive.builtin) {
+      case kBI_quote:
+        return;
+      case kBI_define:
+      case kBI_defun:
+        if (!object_list_is_empty(args) &&
+            object_type(args->list.head) == kOT_symbol)
+          define(self, args->list.head);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  for (; object_type(form) == kOT_list; form = form->list.tail)
+    scan(self, form->list.head);
+}
+
+static void compile(struct s_compiler *self, object_t form, bool tail);
+
+static void compile_body(struct s_compiler *self, object_t forms, bool tail) {
+  if (object_list_is_empty(forms)) {
+    emit(self, kOP_const);
+    emit(self, constant(self, forms));
+    return;
+  }
+  while (object_list_is_empty(forms) == false) {
+    assert(object_type(forms) == kOT_list);
+    bool last = object_list_is_empty(forms->list.tail);
+    compile(self, forms->list.head, tail && last);
+    if (last == false)
+      emit(self, kOP_pop);
+    forms = forms->list.tail;
+  }
+}
+
+static void compile_if(struct s_compiler *self, object_t args, bool tail) {
+  assert(object_list_length(args) >= 2);
+  compile(self, args->list.head, false);
+  emit(self, kOP_jump_if_nil);
+  size_t otherwise = emit(self, 0);
+
+  compile(self, args->list.tail->list.head, tail);
+  emit(self, kOP_jump);
+  size_t end = emit(self, 0);
+
+  patch(self, otherwise);
+  compile_body(self, args->list.tail->list.tail, tail);
+  patch(self, end);
+}
+
+static void compile_let(struct s_compiler *self, object_t args, bool tail) {
+  assert(object_list_length(args) == 2);
+
+  uint32_t count = 0;
+  struct s_list_builder names;
+  object_list_builder_init(&names);
+  for (object_t p = args->list.head; !object_list_is_empty(p);
+       p = p->list.tail->list.tail, count++) {
+    assert(object_type(p->list.head) == kOT_symbol);
+    assert(object_list_is_empty(p->list.tail) == false);
+    object_list_builder_push(&names, p->list.head);
+  }
+
+  emit(self, kOP_enter);
+  emit(self, constant(self, names.list));
+  emit(self, count);
+  object_release(names.list);
+
+  scope_enter(self, names.list);
+  for (object_t p = args->list.head; !object_list_is_empty(p);
+       p = p->list.tail->list.tail) {
+    uint32_t slot = 0;
+    slot_of(names.list, p->list.head, &slot);
+    compile(self, p->list.tail->list.head, false);
+    emit(self, kOP_bind);
+    emit(self, slot);
+  }
+  compile(self, args->list.tail->list.head, tail);
+  emit(self, kOP_leave);
+  scope_leave(self);
+}
+
+static void compile_define(struct s_compiler *self, object_t args) {
+  assert(object_list_length(args) == 2);
+  object_t key = args->list.head;
+  assert(object_type(key) == kOT_symbol);
+  compile(self, args->list.tail->list.head, false);
+  emit(self, kOP_define);
+  emit(self, constant(self, key));
+}
+
+static object_t finish(struct s_compiler *self);
+
+// Compiles the body of a lambda once, when the enclosing code is compiled;
+// every closure created from it shares that code.
+static void compile_lambda(struct s_compiler *self, object_t args) {
+  assert(object_list_length(args) == 2);
+  struct s_compiler inner = {.outer = self, .env = self->env};
+  scope_enter(&inner, args->list.head);
+  scan(&inner, args->list.tail);
+  compile_body(&inner, args->list.tail, true);
+  object_t code = finish(&inner);
+
+  emit(self, kOP_lambda);
+  emit(self, constant(self, args));
+  emit(self, constant(self, code));
+  object_release(code);
+}
+
+static void compile_defun(struct s_compiler *self, object_t args) {
+  assert(object_list_length(args) == 3);
+  object_t key = args->list.head;
+  assert(object_type(key) == kOT_symbol);
+  compile_lambda(self, args->list.tail);
+  emit(self, kOP_define);
+  emit(self, constant(self, key));
+}
+
+static void compile_operator(struct s_compiler *self, opcode_t op,
+                             object_t args) {
+  uint32_t argc = 0;
+  for (; !object_list_is_empty(args); args = args->list.tail, argc++)
+    compile(self, args->list.head, false);
+  emit(self, op);
+  if (op >= kOP_add && op <= kOP_div)
+    emit(self, argc);
+  else
+    assert(argc == 2);
+}
+
+static void compile_call(struct s_compiler *self, object_t form, bool tail) {
+  compile(self, form->list.head, false);
+  emit(self, kOP_form);
+  emit(self, constant(self, form->list.tail));
+  size_t end = emit(self, 0);
+
+  uint32_t argc = 0;
+  for (object_t args = form->list.tail; !object_list_is_empty(args);
+       args = args->list.tail, argc++)
+    compile(self, args->list.head, false);
+  emit(self, tail ? kOP_tail_call : kOP_call);
+  emit(self, argc);
+  patch(self, end);
+}
+
+static void compile(struct s_compiler *self, object_t form, bool tail) {
+  assert(form != NULL);
+  switch (object_type(form)) {
+  case kOT_symbol: {
+    uint32_t depth, slot;
+    if (resolve(self, form, &depth, &slot) == kRS_slot) {
+      emit(self, kOP_local);
+      emit(self, depth);
+      emit(self, slot);
+      emit(self, constant(self, form));
+    } else {
+      emit(self, kOP_lookup);
+      emit(self, constant(self, form));
+      emit(self, self->lookups++);
+    }
+    return;
+  }
+  case kOT_integer:
+  case kOT_string:
+  case kOT_constant:
+    emit(self, kOP_const);
+    emit(self, constant(self, form));
+    return;
+  case kOT_list:
+    break;
+  default:
+    assert(false);
+    return;
+  }
+
+  object_t args = form->list.tail;
+  switch (builtin(self, form->list.head)) {
+  case kBI_quote:
+    assert(object_list_length(args) == 1);
+    emit(self, kOP_const);
+    emit(self, constant(self, args->list.head));
+    break;
+  case kBI_if:
+    compile_if(self, args, tail);
+    break;
+  case kBI_do:
+    compile_body(self, args, tail);
+    break;
+  case kBI_let:
+    compile_let(self, args, tail);
+    break;
+  case kBI_define:
+    compile_define(self, args);
+    break;
+  case kBI_defun:
+    compile_defun(self, args);
+    break;
+  case kBI_lambda:
+    compile_lambda(self, args);
+    break;
+  case kBI_add:
+    assert(object_list_length(args) > 1);
+    compile_operator(self, kOP_add, args);
+    break;
+  case kBI_sub:
+    assert(object_list_length(args) > 1);
+    compile_operator(self, kOP_sub, args);
+    break;
+  case kBI_mul:
+    assert(object_list_length(args) > 1);
+    compile_operator(self, kOP_mul, args);
+    break;
+  case kBI_div:
+    assert(object_list_length(args) > 1);
+    compile_operator(self, kOP_div, args);
+    break;
+  case kBI_eq:
+    compile_operator(self, kOP_eq, args);
+    break;
+  case kBI_lt:
+    compile_operator(self, kOP_lt, args);
+    break;
+  case kBI_gt:
+    compile_operator(self, kOP_gt, args);
+    break;
+  case kBI_le:
+    compile_operator(self, kOP_le, args);
+    break;
+  case kBI_ge:
+    compile_operator(self, kOP_ge, args);
+    break;
+  case kBI_none:
+    compile_call(self, form, tail);
+    break;
+  }
+}
+
+static object_t finish(struct s_compiler *self) {
+  emit(self, kOP_return);
+  free(self->scopes);
+  free(self->defined);
+  free(self->index);
+  return object_create_code(self->ops, self->size, self->constants,
+                            self->count, self->lookups);
+}
+
+object_t object_compile(object_t env, object_t object) {
+  struct s_compiler self = {.env = env};
+  scan(&self, object);
+  compile(&self, object, true);
+  return finish(&self);
+}
+
+// Code replaced while frames below may still be running it.
+static struct {
+  object_t *data;
+  size_t count;
+  size_t capacity;
+} stale;
+
+void object_compile_flush(void) {
+  while (stale.count > 0)
+    object_release(stale.data[--stale.count]);
+}
+
+object_t object_compile_function(object_t func) {
+  assert(func != NULL);
+  assert(object_type(func) == kOT_function);
+  object_t code = func->function.code;
+  if (code != NULL && code->code.builtins != object_builtins_version) {
+    if (stale.count == stale.capacity) {
+      stale.capacity = stale.capacity == 0 ? 16 : stale.capacity * 2;
+      stale.data = realloc(stale.data, stale.capacity * sizeof(*stale.data));
+      assert(stale.data != NULL);
+    }
+    stale.data[stale.count++] = code;
+    func->function.code = NULL;
+  }
+  if (func->function.code == NULL) {
+    struct s_compiler self = {.env = func->function.env};
+    scope_enter(&self, func->function.params);
+    scan(&self, func->function.body);
+    compile_body(&self, func->function.body, true);
+    func->function.code = finish(&self);
+  }
+  return (func->function.code);
+}
@@ -0,0 +1,56 @@
+#ifndef __OBJECT_COMPILE_H__
+#define __OBJECT_COMPILE_H__
+
+#include "object.h"
+
+// Each instruction is one opcode word followed by its operand words.
+typedef enum
+{
+    kOP_const,       // k: push constants[k]
+    kOP_lookup,      // k, c: push the value bound to symbol constants[k],
+                     // cached in caches[c] while it comes from the global frame
+    kOP_local,       // depth, slot, k: push a slot of an enclosing frame
+    kOP_pop,         // drop the top of the stack
+    kOP_jump,        // target
+    kOP_jump_if_nil, // target: pop, jump when the value is nil
+    kOP_define,      // k: bind constants[k] to the top of the stack
+    kOP_lambda,      // k, c: push a closure over constants[k] = (params body)
+                     // running the code in constants[c]
+    kOP_enter,       // k, count: open a frame with the slots constants[k]
+    kOP_bind,        // slot: pop into a slot of the current frame
+    kOP_leave,       // close the frame opened by kOP_enter, keep the result
+    kOP_form,        // k, target: apply a primitive to constants[k] unevaluated
+    kOP_call,        // argc: call the function below the arguments
+    kOP_tail_call,   // argc: same, reusing the current frame
+    kOP_return,      // return the top of the stack to the caller
+    kOP_add,         // argc
+    kOP_sub,         // argc
+    kOP_mul,         // argc
+    kOP_div,         // argc
+    kOP_eq,          // compare the two values on top of the stack
+    kOP_lt,
+    kOP_gt,
+    kOP_le,
+    kOP_ge,
+} opcode_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    object_t object_compile(object_t env, object_t object);
+    object_t object_compile_function(object_t func);
+    // Releases the code object_compile_function replaced, once no frame runs
+    // it anymore.
+    void object_compile_flush(void);
+    object_t object_execute(object_t env, object_t code);
+    // Releases what the stacks of the VM hold, once object_error abandoned
+    // the form being run.
+    void object_vm_unwind(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OBJECT_COMPILE_H__ */
@@ -0,0 +1,461 @@
+#include "object_fasl.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A cache file holds the forms parsed from one source, laid out as the objects
+// themselves, to be loaded instead of parsing the source again while its
+// content does not change:
+//
+//   header   magic, hash, size and time of the source, sizes and checksum
+//            of the sections
+//   heap     the lists and strings of the forms, as placed memory blocks
+//   forms    u64 reference to each top-level form
+//   names    each symbol once: u32 length, then the characters
+//
+// A reference is a tagged integer, kept as is, nil or true, the offset of an
+// object in the heap, or the index of a symbol, interned again at load time.
+// Loading walks the blocks of the heap, whose sizes follow from their type,
+// and patches the references of the lists in place.
+// Numbers are stored in the byte order of the machine that wrote them; a
+// cache moved to another one is rejected by its magic.
+
+#define FASL_MAGIC 0x4C5341464C43ULL // "CLFASL" read as a little-endian u64
+#define FASL_VERSION 4
+
+#define FASL_NIL 2
+#define FASL_TRUE 6
+// low bits of a symbol reference, above them its index
+#define FASL_SYMBOL 4
+
+struct s_header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t symbols;
+  uint64_t hash;
+  uint64_t source;
+  int64_t mtime;
+  uint64_t size;
+  uint64_t forms;
+  uint64_t names;
+  uint64_t sum;
+};
+
+#define FASL_SEED 14695981039346656037ULL
+
+// The whole source is hashed on every run, and the cache checked, so they are
+// hashed a word at a time, as in the body of MurmurHash3: every bit of a word
+// is spread over the whole hash before it is combined, then the hash is
+// rotated, so that a change anywhere reaches all of its bits. The last bytes
+// of `data` are mixed as a word padded with zeros, which only happens at the
+// end of what is hashed, as the sections before the last are whole words.
+static uint64_t fasl_mix(uint64_t hash, uint64_t word) {
+  word *= 0x87c37b91114253d5ULL;
+  word = (word << 31) | (word >> 33);
+  word *= 0x4cf5ad432745937fULL;
+  hash ^= word;
+  hash = (hash << 27) | (hash >> 37);
+  return (hash * 5 + 0x52dce729);
+}
+
+static uint64_t fasl_sum(uint64_t hash, const void *data, size_t size) {
+  const char *bytes = data;
+  size_t words = size / sizeof(uint64_t);
+  for (size_t i = 0; i < words; i++) {
+    uint64_t word = 0;
+    memcpy(&word, bytes + i * sizeof(word), sizeof(word));
+    hash = fasl_mix(hash, word);
+  }
+  if (size % sizeof(uint64_t) != 0) {
+    uint64_t word = 0;
+    memcpy(&word, bytes + words * sizeof(word), size % sizeof(uint64_t));
+    hash = fasl_mix(hash, word);
+  }
+  return (hash);
+}
+
+void object_fasl_source(int fd, struct s_fasl_source *source) {
+  uint64_t hash = FASL_SEED;
+  uint64_t buffer[8 * 1024];
+  off_t offset = 0;
+
+  for (ssize_t size; (size = pread(fd, buffer, sizeof(buffer), offset)) > 0;
+       offset += size)
+    hash = fasl_sum(hash, buffer, size);
+
+  struct stat st;
+  memset(source, 0, sizeof(*source));
+  if (fstat(fd, &st) == 0) {
+    source->size = st.st_size;
+    source->mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  }
+  // the length ends the hash, so that trailing zeros change it
+  source->hash = fasl_mix(hash, offset);
+}
+
+// Writing
+
+struct s_section {
+  char *data;
+  size_t size;
+  size_t capacity;
+};
+
+struct s_fasl_writer {
+  struct s_section heap;
+  struct s_section forms;
+  struct s_section names;
+  // symbols already written, indexed by their position in the names
+  object_t *symbols;
+  uint32_t *indices;
+  size_t count;
+  size_t slots;
+};
+
+// Appends `length` bytes from `ptr`, or zeros when it is NULL.
+static void put(struct s_section *self, const void *ptr, size_t length) {
+  if (self->size + length > self->capacity) {
+    while (self->size + length > self->capacity)
+      self->capacity = self->capacity == 0 ? 4096 : self->capacity * 2;
+    self->data = realloc(self->data, self->capacity);
+    assert(self->data != NULL);
+  }
+  if (ptr != NULL)
+    memcpy(self->data + self->size, ptr, length);
+  else
+    memset(self->data + self->size, 0, length);
+  self->size += length;
+}
+
+static void put_u64(struct s_section *self, uint64_t value) {
+  put(self, &value, sizeof(value));
+}
+
+static void writer_grow(struct s_fasl_writer *self) {
+  size_t slots = self->slots == 0 ? 256 : self->slots * 2;
+  object_t *symbols = calloc(slots, sizeof(*symbols));
+  uint32_t *indices = calloc(slots, sizeof(*indices));
+  assert(symbols != NULL && indices != NULL);
+
+  for (size_t i = 0; i < self->slots; i++) {
+    if (self->symbols[i] == NULL)
+      continue;
+    size_t idx = self->symbols[i]->symbol.hash & (slots - 1);
+    while (symbols[idx] != NULL)
+      idx = (idx + 1) & (slots - 1);
+    symbols[idx] = self->symbols[i];
+    indices[idx] = self->indices[i];
+  }
+
+  free(self->symbols);
+  free(self->indices);
+  self->symbols = symbols;
+  self->indices = indices;
+  self->slots = slots;
+}
+
+static uint32_t writer_symbol(struct s_fasl_writer *self, object_t symbol) {
+  if (2 * (self->count + 1) > self->slots)
+    writer_grow(self);
+
+  size_t idx = symbol->symbol.hash & (self->slots - 1);
+  for (; self->symbols[idx] != NULL; idx = (idx + 1) & (self->slots - 1))
+    if (self->symbols[idx] == symbol)
+      return (self->indices[idx]);
+
+  uint32_t length = strlen(symbol->symbol.name);
+  put(&self->names, &length, sizeof(length));
+  put(&self->names, symbol->symbol.name, length);
+  self->symbols[idx] = symbol;
+  return (self->indices[idx] = self->count++);
+}
+
+// Size of the block of an object whose data takes `size` bytes: the header
+// ends the word before the data, which stays aligned.
+static size_t block_size(size_t size) {
+  return (sizeof(uint64_t) + ((size + 7) & ~(size_t)7));
+}
+
+// Lays out an object of `size` bytes in the heap: returns its offset, that of
+// its data past the block header.
+static uint64_t writer_alloc(struct s_fasl_writer *self, object_type_t type,
+                             size_t size) {
+  size_t data = self->heap.size + sizeof(uint64_t);
+  put(&self->heap, NULL, block_size(size));
+  memory_place(self->heap.data + data - memory_overhead(), type);
+  return (data);
+}
+
+static void writer_store(struct s_fasl_writer *self, uint64_t at,
+                         uint64_t value) {
+  memcpy(self->heap.data + at, &value, sizeof(value));
+}
+
+static uint64_t writer_form(struct s_fasl_writer *self, object_t form) {
+  switch (object_type(form)) {
+  case kOT_constant:
+    return object_list_is_empty(form) ? FASL_NIL : FASL_TRUE;
+  case kOT_integer:
+    return ((uintptr_t)form);
+  case kOT_symbol:
+    return ((uint64_t)writer_symbol(self, form) << 3 | FASL_SYMBOL);
+  case kOT_string: {
+    size_t length = strlen(form->string);
+    uint64_t at = writer_alloc(self, kOT_string, length + 1);
+    memcpy(self->heap.data + at + offsetof(struct s_object, string),
+           form->string, length);
+    return (at);
+  }
+  case kOT_list: {
+    // the cells of a list are laid out in a loop, its elements recursively
+    uint64_t first = 0, last = 0;
+    for (; object_type(form) == kOT_list; form = form->list.tail) {
+      uint64_t at =
+          writer_alloc(self, kOT_list, sizeof(((object_t)NULL)->list));
+      if (last != 0)
+        writer_store(self, last + offsetof(struct s_object, list.tail), at);
+      else
+        first = at;
+      writer_store(self, at + offsetof(struct s_object, list.head),
+                   writer_form(self, form->list.head));
+      last = at;
+    }
+    writer_store(self, last + offsetof(struct s_object, list.tail),
+                 writer_form(self, form));
+    return (first);
+  }
+  default:
+    assert(false);
+    return (FASL_NIL);
+  }
+}
+
+struct s_fasl_writer *object_fasl_create(void) {
+  struct s_fasl_writer *self = calloc(1, sizeof(*self));
+  assert(self != NULL);
+  return (self);
+}
+
+void object_fasl_write(struct s_fasl_writer *self, object_t form) {
+  put_u64(&self->forms, writer_form(self, form));
+}
+
+// The cache is written to a temporary file first and renamed over `path`, so
+// that concurrent runs of the same script never load a partial one. The
+// writer is freed either way.
+bool object_fasl_save(struct s_fasl_writer *self, const char *path,
+                      const struct s_fasl_source *source) {
+  struct s_header header = {
+      .magic = FASL_MAGIC,
+      .version = FASL_VERSION,
+      .symbols = self->count,
+      .hash = source->hash,
+      .source = source->size,
+      .mtime = source->mtime,
+      .size = self->heap.size,
+      .forms = self->forms.size / sizeof(uint64_t),
+      .names = self->names.size,
+      .sum = FASL_SEED,
+  };
+  const struct s_section *sections[] = {&self->heap, &self->forms,
+                                        &self->names};
+  for (size_t i = 0; i < sizeof(sections) / sizeof(*sections); i++)
+    header.sum = fasl_sum(header.sum, sections[i]->data, sections[i]->size);
+
+  char *temp = malloc(strlen(path) + 16);
+  assert(temp != NULL);
+  sprintf(temp, "%s.%d", path, (int)getpid());
+  FILE *fp = fopen(temp, "wb");
+  bool saved = fp != NULL;
+  if (saved) {
+    saved = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (size_t i = 0; i < sizeof(sections) / sizeof(*sections); i++)
+      saved = saved && (sections[i]->size == 0 ||
+                        fwrite(sections[i]->data, sections[i]->size, 1, fp) ==
+                            1);
+    saved = fclose(fp) == 0 && saved;
+    saved = saved && rename(temp, path) == 0;
+    if (saved == false)
+      unlink(temp);
+  }
+
+  free(temp);
+  free(self->heap.data);
+  free(self->forms.data);
+  free(self->names.data);
+  free(self->symbols);
+  free(self->indices);
+  free(self);
+  return (saved);
+}
+
+// Reading
+
+struct s_fasl_reader {
+  char *heap;
+  uint64_t size;
+  object_t *symbols;
+  uint32_t count;
+  const uint64_t *forms;
+  // forms not read yet
+  uint64_t left;
+};
+
+// The object `value` refers to, or NULL when it is out of the cache.
+static object_t reader_decode(struct s_fasl_reader *self, uint64_t value) {
+  if ((value & 1) != 0)
+    return ((object_t)(uintptr_t)value);
+  if (value == FASL_NIL)
+    return (&object_nil);
+  if (value == FASL_TRUE)
+    return (&object_true);
+  if ((value & 7) == FASL_SYMBOL)
+    return (value >> 3) < self->count ? self->symbols[value >> 3] : NULL;
+  if ((value & 7) != 0 || value < sizeof(uint64_t) || value >= self->size)
+    return (NULL);
+  return ((object_t)(self->heap + value));
+}
+
+// Patches the references of the object in the block at `*at`, and moves
+// `*at` to the next block.
+static bool reader_patch(struct s_fasl_reader *self, uint64_t *at) {
+  uint64_t data = *at + sizeof(uint64_t);
+  object_t object = (object_t)(self->heap + data);
+  if (data > self->size)
+    return (false);
+
+  size_t size = 0;
+  switch (memory_kind(object)) {
+  case kOT_list: {
+    size = block_size(sizeof(object->list));
+    if (*at + size > self->size)
+      return (false);
+    object_t *fields[] = {&object->list.head, &object->list.tail};
+    for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); i++) {
+      uint64_t value = 0;
+      memcpy(&value, fields[i], sizeof(value));
+      if ((*fields[i] = reader_decode(self, value)) == NULL)
+        return (false);
+    }
+    break;
+  }
+  case kOT_string: {
+    const char *string = object->string;
+    const char *nul = memchr(string, 0, self->heap + self->size - string);
+    if (nul == NULL)
+      return (false);
+    size = block_size(nul + 1 - string);
+    break;
+  }
+  default:
+    return (false);
+  }
+  *at += size;
+  return (true);
+}
+
+// The file is read whole into memory of its own, where the forms are patched
+// in place: every page gets written to, so a private mapping of the file
+// would only add a fault per page, while anonymous memory can use huge pages.
+// It is never released, as the functions defined by the script keep
+// referencing their forms. The file is trusted to hold well-formed objects
+// once its checksum matches and its references are found within bounds.
+struct s_fasl_reader *object_fasl_load(const char *path,
+                                       const struct s_fasl_source *source) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return (NULL);
+
+  struct stat st;
+  char *addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct s_header))
+    addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  bool loaded = addr != MAP_FAILED;
+  if (loaded)
+    madvise(addr, st.st_size, MADV_HUGEPAGE);
+  for (off_t offset = 0; loaded && offset < st.st_size;) {
+    ssize_t size = pread(fd, addr + offset, st.st_size - offset, offset);
+    loaded = size > 0;
+    offset += size;
+  }
+  close(fd);
+  if (addr != MAP_FAILED && !loaded)
+    munmap(addr, st.st_size);
+  if (!loaded)
+    return (NULL);
+
+  const struct s_header *header = (const void *)addr;
+  uint64_t size = st.st_size - sizeof(*header);
+  if (header->magic != FASL_MAGIC || header->version != FASL_VERSION ||
+      header->hash != source->hash || header->source != source->size ||
+      header->mtime != source->mtime || header->size % 8 != 0 ||
+      header->forms > size / 8 ||
+      header->size + header->forms * 8 + header->names != size ||
+      header->sum != fasl_sum(FASL_SEED, header + 1, size)) {
+    munmap(addr, st.st_size);
+    return (NULL);
+  }
+
+  struct s_fasl_reader *self = calloc(1, sizeof(*self));
+  assert(self != NULL);
+  self->heap = addr + sizeof(*header);
+  self->size = header->size;
+  self->forms = (const uint64_t *)(self->heap + self->size);
+  self->left = header->forms;
+  self->symbols = calloc(header->symbols + 1, sizeof(object_t));
+  assert(self->symbols != NULL);
+
+  const char *names = (const char *)(self->forms + header->forms);
+  const char *end = names + header->names;
+  bool valid = true;
+  for (; valid && self->count < header->symbols; self->count++) {
+    uint32_t length = 0;
+    valid = (size_t)(end - names) >= sizeof(length);
+    if (valid) {
+      memcpy(&length, names, sizeof(length));
+      names += sizeof(length);
+      valid = (size_t)(end - names) >= length;
+    }
+    if (valid) {
+      // interned symbols live as long as the process
+      object_t symbol = object_create_symbol_slice(names, length);
+      object_release(symbol);
+      self->symbols[self->count] = symbol;
+      names += length;
+    }
+  }
+
+  for (uint64_t at = 0; valid && at < self->size;)
+    valid = reader_patch(self, &at);
+  for (uint64_t i = 0; valid && i < header->forms; i++)
+    valid = reader_decode(self, self->forms[i]) != NULL;
+
+  if (valid == false) {
+    free(self->symbols);
+    free(self);
+    munmap(addr, st.st_size);
+    return (NULL);
+  }
+  return (self);
+}
+
+object_t object_fasl_read(struct s_fasl_reader *self) {
+  if (self->left == 0)
+    return (NULL);
+  object_t form = reader_decode(self, *self->forms++);
+  self->left -= 1;
+  return object_retain(form);
+}
+
+void object_fasl_close(struct s_fasl_reader *self) {
+  free(self->symbols);
+  free(self);
+}
@@ -0,0 +1,46 @@
+#ifndef __OBJECT_FASL_H__
+#define __OBJECT_FASL_H__
+
+#include "object.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct s_fasl_reader;
+    struct s_fasl_writer;
+
+    // What the cache of a source is keyed on: a hash of its whole content,
+    // and its size and modification time, which must all match.
+    struct s_fasl_source
+    {
+        uint64_t hash;
+        uint64_t size;
+        // nanoseconds since the epoch
+        int64_t mtime;
+    };
+
+    void object_fasl_source(int fd, struct s_fasl_source *source);
+
+    // Opens the cache `path`, or returns NULL when it is missing, damaged or
+    // was saved for another source. Forms are then read back one by one.
+    struct s_fasl_reader *object_fasl_load(const char *path,
+                                           const struct s_fasl_source *source);
+    object_t object_fasl_read(struct s_fasl_reader *self);
+    void object_fasl_close(struct s_fasl_reader *self);
+
+    // Records forms one by one, then writes them all to `path`.
+    struct s_fasl_writer *object_fasl_create(void);
+    void object_fasl_write(struct s_fasl_writer *self, object_t form);
+    bool object_fasl_save(struct s_fasl_writer *self, const char *path,
+                          const struct s_fasl_source *source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OBJECT_FASL_H__ */
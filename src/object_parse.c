@@ -1,112 +1,172 @@
 #include <assert.h>
-#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "object_parse.h"
+#include "scan.h"
 
-#define next_char(s, skip)                                                     \
-  (((skip) ? (stream_skip((s), " \n\r\t")) : (s))->next(s))
-#define peek_char(s, skip)                                                     \
-  (((skip) ? (stream_skip((s), " \n\r\t")) : (s))->peek(s))
-
-static object_t parse_symbol(stream_t s, char c) {
-  size_t capacity = 1;
-  size_t length = 0;
-  char *name = malloc(capacity + 1);
-
-  name[length++] = c;
-  name[length] = 0;
-  while (isalnum(peek_char(s, false)) ||
-         strchr("_-+=!@#$%^&*<>", peek_char(s, false))) {
-    if (length == capacity) {
-      capacity += capacity;
-      name = realloc(name, capacity + 1);
+#define next_char(s, skip) stream_next((skip) ? skip_space(s) : (s))
+#define peek_char(s, skip) stream_peek((skip) ? skip_space(s) : (s))
+
+static stream_t skip_space(stream_t s) {
+  do
+    s->cur = scan_space(s->cur, s->end);
+  while (s->cur == s->end && stream_peek(s) != EOF);
+  return (s);
+}
+
+static bool is_symbol(int c) { //
+  return scan_is(c, kCC_symbol);
+}
+
+static bool is_digit(int c) { //
+  return scan_is(c, kCC_digit);
+}
+
+// The character a string holds for the one that follows a run of plain
+// characters, EOF at the end of the string.
+static inline int string_char(stream_t s) {
+  int ch = next_char(s, false);
+  if (ch == '"')
+    return (EOF);
+  if (ch == '\\') {
+    ch = next_char(s, false);
+    switch (ch) {
+    case 'n':
+      ch = '\n';
+      break;
+    case 'r':
+      ch = '\r';
+      break;
+    case 't':
+      ch = '\t';
+      break;
+    default:
+      break;
     }
-    name[length++] = next_char(s, false);
-    name[length] = 0;
   }
+  assert(ch != EOF);
+  return (ch);
+}
+
+static inline int parse_digits(stream_t s, int value) {
+  while (is_digit(peek_char(s, false)))
+    value = value * 10 + (next_char(s, false) - '0');
+  return (value);
+}
+
+// Tokens are created straight from the block of the stream that holds them.
+// Only the text of a token that runs to the end of a block, or that has to be
+// unescaped, is gathered here first.
+static struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+} token;
+
+static void token_append(const char *data, size_t length) {
+  if (length == 0)
+    return;
+  if (token.length + length > token.capacity) {
+    while (token.length + length > token.capacity)
+      token.capacity = token.capacity == 0 ? 64 : token.capacity * 2;
+    token.data = realloc(token.data, token.capacity);
+    assert(token.data != NULL);
+  }
+  memcpy(token.data + token.length, data, length);
+  token.length += length;
+}
 
-  object_t result = object_create_symbol(name);
-  free(name);
-  return result;
+static object_t parse_symbol(stream_t s, char prefix) {
+  token.length = 0;
+  if (prefix != 0)
+    token_append(&prefix, 1);
+
+  for (;;) {
+    const char *start = s->cur;
+    s->cur = scan_symbol(s->cur, s->end);
+    if (s->cur < s->end && token.length == 0)
+      return object_create_symbol_slice(start, s->cur - start);
+    token_append(start, s->cur - start);
+    if (s->cur < s->end || is_symbol(peek_char(s, false)) == false)
+      break;
+  }
+  return object_create_symbol_slice(token.data, token.length);
 }
 
 static object_t parse_string(stream_t s) {
-  size_t capacity = 1;
-  size_t length = 0;
-  char *name = malloc(capacity + 1);
+  token.length = 0;
 
-  int ch = next_char(s, false);
-  while (ch != '"') {
-    if (ch == '\\') {
-      ch = next_char(s, false);
-      switch (ch) {
-      case 'n':
-        ch = '\n';
-        break;
-      case 'r':
-        ch = '\r';
-        break;
-      case 't':
-        ch = '\t';
-        break;
-      default:
-        break;
-      }
+  for (;;) {
+    const char *start = s->cur;
+    s->cur = scan_string(s->cur, s->end);
+    if (s->cur < s->end && *s->cur == '"' && token.length == 0) {
+      object_t result = object_create_string_slice(start, s->cur - start);
+      s->cur += 1;
+      return result;
     }
-    assert(ch != EOF);
-    if (length == capacity) {
-      capacity += capacity;
-      name = realloc(name, capacity + 1);
-    }
-    name[length++] = ch;
-    name[length] = 0;
-    ch = next_char(s, false);
-  }
+    token_append(start, s->cur - start);
 
-  object_t result = object_create_string(name);
-  free(name);
-  return result;
+    int ch = string_char(s);
+    if (ch == EOF)
+      break;
+    char c = ch;
+    token_append(&c, 1);
+  }
+  return object_create_string_slice(token.data, token.length);
 }
 
 object_t parse_number(stream_t s, int sign, int value) {
-  while (isdigit(peek_char(s, false)))
-    value = value * 10 + (next_char(s, false) - '0');
-  return object_create_integer(sign * value);
+  return object_create_integer(sign * parse_digits(s, value));
 }
 
 object_t parse_list(stream_t s) {
-  object_t head = object_list_create();
-  while (peek_char(s, true) != ')')
-    object_new(object, object_parse(s), { //
-      object_list_push(&head, object);
-    });
+  struct s_list_builder head;
+  object_list_builder_init(&head);
+  while (peek_char(s, true) != ')') {
+    object_t object = object_parse(s);
+    // input cut in the middle of a list, as by a client going away
+    if (object == NULL) {
+      printf("ERROR: unterminated list\n");
+      object_release(head.list);
+      return (NULL);
+    }
+    object_list_builder_push(&head, object);
+    object_release(object);
+  }
   next_char(s, false);
-  return (head);
+  return (head.list);
 }
 
 object_t parse_quote(stream_t s) {
-  object_t list = object_list_create();
+  struct s_list_builder list;
+  object_list_builder_init(&list);
 
   object_new(object,                        //
              object_create_symbol("quote"), //
-             object_list_push(&list, object));
+             object_list_builder_push(&list, object));
 
   object_new(object,          //
              object_parse(s), //
-             object_list_push(&list, object));
+             object_list_builder_push(&list, object));
 
-  return (list);
+  return (list.list);
 }
 
 object_t object_parse(stream_t s) {
-  int c = next_char(s, true);
+  int c = peek_char(s, true);
 
   if (c == EOF)
     return NULL;
 
+  // symbols are read from the stream itself, only the others consume `c` here
+  if (is_symbol(c) && !is_digit(c) && c != '-')
+    return parse_symbol(s, 0);
+  next_char(s, false);
+
   if (c == '(')
     return parse_list(s);
 
@@ -116,16 +176,243 @@ object_t object_parse(stream_t s) {
   if (c == '"')
     return parse_string(s);
 
-  if (isdigit(c))
+  if (is_digit(c))
     return parse_number(s, 0 + 1, c - '0');
 
-  if (c == '-' && isdigit(peek_char(s, false)))
+  if (c == '-' && is_digit(peek_char(s, false)))
     return parse_number(s, 0 - 1, next_char(s, false) - '0');
 
-  if (isalpha(c) || strchr("_-+=!@#$%^&*<>", c))
+  if (c == '-')
     return parse_symbol(s, c);
 
   printf("ERROR: Don't know how to handle '%c'\n", c);
   assert(false);
   return (NULL);
 }
+
+// A form is parsed into records of 64-bit words, in prefix order: the kind of
+// each record is in its low byte, and its value in the other bits. The text of
+// a symbol, a string or an error follows its record, padded to a whole word.
+// A form starts with the number of words of its records.
+typedef enum {
+  kPR_integer, // the integer
+  kPR_symbol,  // the length of the name
+  kPR_string,  // the length of the string
+  kPR_list,    // the number of elements, which follow
+  kPR_failed,  // the same, for a list that is not terminated
+  kPR_error,   // the length of the message
+} parse_record_t;
+
+#define record(_kind, _value) (((uint64_t)(_value) << 8) | (_kind))
+
+typedef enum {
+  kPS_form,  // a form was parsed
+  kPS_end,   // the input ended before a form
+  kPS_error, // a failed form was appended, its errors print when it is built
+} parse_status_t;
+
+static void records_grow(struct s_parse_records *self, size_t words) {
+  while (self->count + words > self->capacity)
+    self->capacity = self->capacity == 0 ? 256 : self->capacity * 2;
+  self->data = realloc(self->data, self->capacity * sizeof(*self->data));
+  assert(self->data != NULL);
+}
+
+static inline size_t records_reserve(struct s_parse_records *self,
+                                     size_t words) {
+  if (__builtin_expect(self->count + words > self->capacity, false))
+    records_grow(self, words);
+  size_t at = self->count;
+  self->count += words;
+  return (at);
+}
+
+static void records_push(struct s_parse_records *self, uint64_t word) {
+  self->data[records_reserve(self, 1)] = word;
+}
+
+// Appends `data` to the text of the record at `at`, `length` bytes long so far.
+static inline void records_text(struct s_parse_records *self, size_t at,
+                                size_t length, const char *data,
+                                size_t size) {
+  if (size == 0)
+    return;
+  records_reserve(self, (length + size + 7) / 8 - (length + 7) / 8);
+  memcpy((char *)(self->data + at + 1) + length, data, size);
+}
+
+static parse_status_t record_error(struct s_parse_records *records,
+                                   const char *message) {
+  size_t at = records_reserve(records, 1), length = strlen(message);
+  records_text(records, at, 0, message, length);
+  records->data[at] = record(kPR_error, length);
+  return (kPS_error);
+}
+
+static parse_status_t record_form(stream_t s, struct s_parse_records *records);
+
+// Symbols are copied from the stream by runs, a block of the stream at a time.
+static parse_status_t record_symbol(stream_t s,
+                                    struct s_parse_records *records,
+                                    char prefix) {
+  size_t at = records_reserve(records, 1), length = 0;
+  if (prefix != 0)
+    records_text(records, at, length++, &prefix, 1);
+
+  for (;;) {
+    const char *start = s->cur;
+    s->cur = scan_symbol(s->cur, s->end);
+    records_text(records, at, length, start, s->cur - start);
+    length += s->cur - start;
+    if (s->cur < s->end || is_symbol(peek_char(s, false)) == false)
+      break;
+  }
+  records->data[at] = record(kPR_symbol, length);
+  return (kPS_form);
+}
+
+static parse_status_t record_string(stream_t s,
+                                    struct s_parse_records *records) {
+  size_t at = records_reserve(records, 1), length = 0;
+
+  for (;;) {
+    const char *start = s->cur;
+    s->cur = scan_string(s->cur, s->end);
+    records_text(records, at, length, start, s->cur - start);
+    length += s->cur - start;
+
+    int ch = string_char(s);
+    if (ch == EOF)
+      break;
+    char c = ch;
+    records_text(records, at, length++, &c, 1);
+  }
+  records->data[at] = record(kPR_string, length);
+  return (kPS_form);
+}
+
+static parse_status_t record_number(stream_t s,
+                                    struct s_parse_records *records, int sign,
+                                    int value) {
+  value = sign * parse_digits(s, value);
+  records_push(records, record(kPR_integer, (uint32_t)value));
+  return (kPS_form);
+}
+
+static parse_status_t record_list(stream_t s, struct s_parse_records *records) {
+  size_t at = records_reserve(records, 1), count = 0;
+  for (; peek_char(s, true) != ')'; count++) {
+    parse_status_t status = record_form(s, records);
+    // input cut in the middle of a list, as by a client going away
+    if (status != kPS_form) {
+      count += status == kPS_error;
+      records->data[at] = record(kPR_failed, count);
+      return (kPS_error);
+    }
+  }
+  next_char(s, false);
+  records->data[at] = record(kPR_list, count);
+  return (kPS_form);
+}
+
+static parse_status_t record_quote(stream_t s,
+                                   struct s_parse_records *records) {
+  static const char quote[] = "quote";
+  size_t at = records_reserve(records, 2);
+  records_text(records, at + 1, 0, quote, sizeof(quote) - 1);
+  records->data[at + 1] = record(kPR_symbol, sizeof(quote) - 1);
+  // like object_parse, a quote of nothing or of a failed form is (quote)
+  parse_status_t status = record_form(s, records);
+  records->data[at] = record(kPR_list, status == kPS_end ? 1 : 2);
+  return (kPS_form);
+}
+
+static parse_status_t record_form(stream_t s, struct s_parse_records *records) {
+  int c = peek_char(s, true);
+
+  if (c == EOF)
+    return (kPS_end);
+
+  // symbols are read from the stream itself, only the others consume `c` here
+  if (is_symbol(c) && !is_digit(c) && c != '-')
+    return record_symbol(s, records, 0);
+  next_char(s, false);
+
+  if (c == '(')
+    return record_list(s, records);
+
+  if (c == '\'')
+    return record_quote(s, records);
+
+  if (c == '"')
+    return record_string(s, records);
+
+  if (is_digit(c))
+    return record_number(s, records, 0 + 1, c - '0');
+
+  if (c == '-' && is_digit(peek_char(s, false)))
+    return record_number(s, records, 0 - 1, next_char(s, false) - '0');
+
+  if (c == '-')
+    return record_symbol(s, records, c);
+
+  char message[64];
+  snprintf(message, sizeof(message), "Don't know how to handle '%c'", c);
+  assert(false);
+  return record_error(records, message);
+}
+
+bool object_parse_records(stream_t s, struct s_parse_records *records) {
+  size_t start = records_reserve(records, 1);
+  if (record_form(s, records) == kPS_end) {
+    records->count = start;
+    return (false);
+  }
+  records->data[start] = records->count - start - 1;
+  return (true);
+}
+
+static object_t build(const uint64_t *data, size_t *at) {
+  uint64_t word = data[(*at)++];
+  size_t value = word >> 8;
+  const char *text = (const char *)(data + *at);
+
+  switch ((parse_record_t)(word & 0xff)) {
+  case kPR_integer:
+    return object_create_integer((int32_t)(uint32_t)value);
+  case kPR_symbol:
+    *at += (value + 7) / 8;
+    return object_create_symbol_slice(text, value);
+  case kPR_string:
+    *at += (value + 7) / 8;
+    return object_create_string_slice(text, value);
+  case kPR_list:
+  case kPR_failed: {
+    struct s_list_builder list;
+    object_list_builder_init(&list);
+    for (size_t i = 0; i < value; i++)
+      object_new(object, build(data, at),
+                 object_list_builder_push(&list, object));
+    if ((word & 0xff) == kPR_list)
+      return (list.list);
+    printf("ERROR: unterminated list\n");
+    object_release(list.list);
+    return (NULL);
+  }
+  case kPR_error:
+    *at += (value + 7) / 8;
+    printf("ERROR: %.*s\n", (int)value, text);
+    return (NULL);
+  default:
+    assert(false);
+    return (NULL);
+  }
+}
+
+object_t object_parse_build(const struct s_parse_records *records,
+                            size_t *at) {
+  assert(*at < records->count);
+  size_t start = *at + 1;
+  *at = start + records->data[*at];
+  return build(records->data, &start);
+}
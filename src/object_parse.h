@@ -4,6 +4,9 @@
 #include "object.h"
 #include "stream.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -11,6 +14,23 @@ extern "C"
 
     object_t object_parse(stream_t s);
 
+    // Parsing runs in two steps. object_parse_records parses the next form
+    // of `s` into records, which needs neither the allocator nor the symbol
+    // table, so that another thread can run it; it returns false at the end
+    // of the input. object_parse_build makes the objects of the form at
+    // `*at`, and moves `*at` past it: a form that could not be parsed prints
+    // its errors and gives NULL.
+    struct s_parse_records
+    {
+        uint64_t *data;
+        size_t count;
+        size_t capacity;
+    };
+
+    bool object_parse_records(stream_t s, struct s_parse_records *records);
+    object_t object_parse_build(const struct s_parse_records *records,
+                                size_t *at);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,369 @@
+#include "object_compile.h"
+#include "profile.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#define STACK_SIZE (1 << 20)
+#define FRAMES_SIZE (1 << 18)
+
+struct s_frame {
+  object_t code;
+  const uint32_t *ip;
+  // owned reference on the environment the code runs in
+  object_t env;
+  // first stack slot owned by the frame; it holds the called function
+  size_t base;
+  // profile frames to unwind to when the frame returns or makes a tail call
+  size_t mark;
+};
+
+static object_t stack[STACK_SIZE];
+static size_t top = 0;
+
+static struct s_frame frames[FRAMES_SIZE];
+static size_t depth = 0;
+
+static inline void push(object_t object) {
+  // primitives such as an empty `do` may produce no value at all
+  if (object == NULL)
+    object = object_list_create();
+  if (top == STACK_SIZE) {
+    object_release(object);
+    object_error("stack overflow");
+  }
+  stack[top++] = object;
+}
+
+static inline object_t pop(void) {
+  assert(top > 0);
+  return (stack[--top]);
+}
+
+// Moves the `argc` arguments on top of the stack into the slots of a new frame
+// for `func`.
+static object_t bind(object_t func, uint32_t argc) {
+  if (object_type(func) != kOT_function)
+    object_error("not a function");
+  size_t count = object_list_length(func->function.params);
+  if (argc != count)
+    object_error("wrong number of arguments: %u for %zu", argc, count);
+
+  object_t env =
+      object_create_frame(func->function.env, func->function.params, argc);
+
+  top -= argc;
+  for (uint32_t i = 0; i < argc; i++)
+    env->env.slots[i] = stack[top + i];
+  return (env);
+}
+
+// Calls a primitive on the `argc` arguments on top of the stack, in place,
+// then drops them and the primitive below them.
+static object_t primitive(object_t func, uint32_t argc) {
+  assert(func->primitive.function != NULL);
+  object_t result = func->primitive.function(argc, stack + top - argc);
+  for (argc += 1; argc > 0; argc--)
+    object_release(pop());
+  return (result);
+}
+
+static object_t arithmetic(opcode_t op, uint32_t argc) {
+  object_t *argv = stack + top - argc;
+  int result = 0;
+
+  for (uint32_t i = 0; i < argc; i++) {
+    assert(object_type(argv[i]) == kOT_integer);
+    int value = object_integer(argv[i]);
+    if (i == 0)
+      result = value;
+    else if (op == kOP_add)
+      result = result + value;
+    else if (op == kOP_sub)
+      result = result - value;
+    else if (op == kOP_mul)
+      result = result * value;
+    else
+      result = result / value;
+    object_release(argv[i]);
+  }
+  top -= argc;
+  return object_create_integer(result);
+}
+
+static object_t compare(opcode_t op) {
+  object_t argr = pop();
+  object_t argl = pop();
+  bool result = false;
+
+  if (object_type(argl) == object_type(argr)) {
+    switch (object_type(argl)) {
+    case kOT_integer: {
+      int l = object_integer(argl), r = object_integer(argr);
+      result = op == kOP_eq   ? l == r
+               : op == kOP_lt ? l < r
+               : op == kOP_gt ? l > r
+               : op == kOP_le ? l <= r
+                              : l >= r;
+      break;
+    }
+    default:
+      assert(false);
+      break;
+    }
+  }
+  object_release(argl);
+  object_release(argr);
+  return object_create_boolean(result);
+}
+
+object_t object_execute(object_t env, object_t code) {
+  static const void *const dispatch[] = {
+      [kOP_const] = &&op_const,
+      [kOP_lookup] = &&op_lookup,
+      [kOP_local] = &&op_local,
+      [kOP_pop] = &&op_pop,
+      [kOP_jump] = &&op_jump,
+      [kOP_jump_if_nil] = &&op_jump_if_nil,
+      [kOP_define] = &&op_define,
+      [kOP_lambda] = &&op_lambda,
+      [kOP_enter] = &&op_enter,
+      [kOP_bind] = &&op_bind,
+      [kOP_leave] = &&op_leave,
+      [kOP_form] = &&op_form,
+      [kOP_call] = &&op_call,
+      [kOP_tail_call] = &&op_tail_call,
+      [kOP_return] = &&op_return,
+      [kOP_add] = &&op_arithmetic,
+      [kOP_sub] = &&op_arithmetic,
+      [kOP_mul] = &&op_arithmetic,
+      [kOP_div] = &&op_arithmetic,
+      [kOP_eq] = &&op_compare,
+      [kOP_lt] = &&op_compare,
+      [kOP_gt] = &&op_compare,
+      [kOP_le] = &&op_compare,
+      [kOP_ge] = &&op_compare,
+  };
+
+  assert(env != NULL);
+  assert(code != NULL);
+  assert(object_type(code) == kOT_code);
+  if (depth == FRAMES_SIZE)
+    object_error("stack overflow");
+
+  const size_t entry = depth;
+  struct s_frame *frame = &frames[depth++];
+  frame->code = code;
+  frame->env = object_retain(env);
+  frame->base = top;
+  frame->mark = profile_mark();
+
+  const uint32_t *ops = code->code.ops;
+  const uint32_t *ip = ops;
+  object_t *constants = code->code.constants;
+  uint32_t op = 0;
+
+#define NEXT goto *dispatch[op = *ip++]
+#define ENTER(_code)                                                           \
+  do {                                                                         \
+    frame->code = (_code);                                                     \
+    ip = ops = frame->code->code.ops;                                          \
+    constants = frame->code->code.constants;                                   \
+  } while (0)
+
+  NEXT;
+
+op_const:
+  push(object_retain(constants[*ip++]));
+  NEXT;
+
+op_lookup: {
+  object_t symbol = constants[*ip++];
+  struct s_cache *cache = &frame->code->code.caches[*ip++];
+  // calls to globals, such as a recursive call, mostly stop here
+  object_t value = cache->version == object_version
+                       ? cache->value
+                       : object_env_lookup(frame->env, symbol, cache);
+  if (value == NULL)
+    object_error("unbound name: %s", symbol->symbol.name);
+  push(object_retain(value));
+  NEXT;
+}
+
+op_local: {
+  uint32_t hops = *ip++;
+  uint32_t slot = *ip++;
+  object_t symbol = constants[*ip++];
+  object_t env = frame->env;
+  for (; hops > 0; hops--)
+    env = env->env.parent;
+  assert(slot < env->env.count);
+  object_t value = env->env.slots[slot];
+  // not bound yet: a let value referring to a name it is about to shadow
+  if (value == NULL)
+    value = object_env_find(env->env.parent, symbol);
+  if (value == NULL)
+    object_error("unbound name: %s", symbol->symbol.name);
+  push(object_retain(value));
+  NEXT;
+}
+
+op_pop:
+  object_release(pop());
+  NEXT;
+
+op_jump:
+  ip = ops + *ip;
+  NEXT;
+
+op_jump_if_nil: {
+  uint32_t target = *ip++;
+  object_t value = pop();
+  bool is_nil = object_list_is_empty(value);
+  object_release(value);
+  if (is_nil)
+    ip = ops + target;
+  NEXT;
+}
+
+op_define:
+  object_env_add(frame->env, constants[*ip++], stack[top - 1]);
+  NEXT;
+
+op_lambda: {
+  object_t args = constants[*ip++];
+  object_t func =
+      object_create_function(args->list.head, args->list.tail, frame->env);
+  func->function.code = object_retain(constants[*ip++]);
+  push(func);
+  NEXT;
+}
+
+op_enter: {
+  object_t names = constants[*ip++];
+  uint32_t count = *ip++;
+  object_t env = object_create_frame(frame->env, names, count);
+  // the new frame holds the reference on its parent
+  object_release(frame->env);
+  frame->env = env;
+  NEXT;
+}
+
+op_bind: {
+  object_t *slot = &frame->env->env.slots[*ip++];
+  if (*slot != NULL)
+    object_release(*slot);
+  *slot = pop();
+  NEXT;
+}
+
+op_leave: {
+  object_t parent = object_retain(frame->env->env.parent);
+  object_release(frame->env);
+  frame->env = parent;
+  NEXT;
+}
+
+op_form: {
+  object_t args = constants[*ip++];
+  uint32_t target = *ip++;
+  object_t func = stack[top - 1];
+  switch (object_type(func)) {
+  case kOT_primitive:
+    if (func->primitive.special == NULL)
+      break;
+    frame->ip = ip;
+    object_t result = func->primitive.special(frame->env, args);
+    object_release(pop());
+    push(result);
+    ip = ops + target;
+    break;
+  case kOT_function:
+    break;
+  default:
+    object_error("not a function");
+  }
+  NEXT;
+}
+
+op_call: {
+  uint32_t argc = *ip++;
+  object_t func = stack[top - argc - 1];
+  if (object_type(func) == kOT_primitive) {
+    frame->ip = ip;
+    push(primitive(func, argc));
+    NEXT;
+  }
+  if (depth == FRAMES_SIZE)
+    object_error("stack overflow");
+  object_t callee = bind(func, argc);
+
+  frame->ip = ip;
+  frame = &frames[depth++];
+  frame->env = callee;
+  frame->base = top - 1;
+  frame->mark = profile_mark();
+  profile_push(func);
+  ENTER(object_compile_function(func));
+  NEXT;
+}
+
+op_tail_call: {
+  uint32_t argc = *ip++;
+  object_t func = stack[top - argc - 1];
+  if (object_type(func) == kOT_primitive) {
+    frame->ip = ip;
+    push(primitive(func, argc));
+    NEXT;
+  }
+  object_t callee = bind(func, argc);
+
+  top -= 1;
+  while (top > frame->base)
+    object_release(pop());
+  push(func);
+  object_release(frame->env);
+  frame->env = callee;
+  profile_unwind(frame->mark);
+  profile_push(func);
+  ENTER(object_compile_function(func));
+  NEXT;
+}
+
+op_return: {
+  object_t result = pop();
+  while (top > frame->base)
+    object_release(pop());
+  object_release(frame->env);
+  profile_unwind(frame->mark);
+  if (--depth == entry)
+    return (result);
+
+  frame = &frames[depth - 1];
+  ops = frame->code->code.ops;
+  ip = frame->ip;
+  constants = frame->code->code.constants;
+  push(result);
+  NEXT;
+}
+
+op_arithmetic: {
+  uint32_t argc = *ip++;
+  push(arithmetic(op, argc));
+  NEXT;
+}
+
+op_compare:
+  push(compare(op));
+  NEXT;
+
+#undef ENTER
+#undef NEXT
+}
+
+void object_vm_unwind(void) {
+  while (top > 0)
+    object_release(pop());
+  while (depth > 0)
+    object_release(frames[--depth].env);
+}
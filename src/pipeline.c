@@ -0,0 +1,116 @@
+#include "pipeline.h"
+#include "object_parse.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// The reader thread parses the forms into records, which need neither the
+// allocator nor the symbol table, by batches of about PIPELINE_BATCH words.
+// Batches go through a ring of PIPELINE_SLOTS slots, from the reader thread
+// only to the main thread only, which builds their forms in order. Each side
+// counts the slots it may take with a semaphore: a hand-off is an atomic
+// operation, and a side only sleeps while the ring is full or empty.
+#define PIPELINE_SLOTS 8
+#define PIPELINE_BATCH (16 * 1024)
+
+struct s_slot {
+  struct s_parse_records records;
+  // no batch follows this one
+  bool last;
+};
+
+struct s_pipeline {
+  stream_t stream;
+  pthread_t thread;
+  // slots the reader thread may fill, and the main thread may take
+  sem_t free;
+  sem_t full;
+  atomic_bool stopping;
+  struct s_slot slots[PIPELINE_SLOTS];
+  // slot taken by the main thread, NULL for none, and where its next form is
+  struct s_slot *slot;
+  size_t next;
+  size_t at;
+  bool ended;
+};
+
+static void take(sem_t *sem) {
+  while (sem_wait(sem) != 0)
+    assert(errno == EINTR);
+}
+
+static void *read_ahead(void *arg) {
+  struct s_pipeline *self = arg;
+
+  for (size_t next = 0;; next = (next + 1) % PIPELINE_SLOTS) {
+    take(&self->free);
+    struct s_slot *slot = &self->slots[next];
+    slot->records.count = 0;
+    slot->last = atomic_load(&self->stopping);
+    while (!slot->last && slot->records.count < PIPELINE_BATCH)
+      slot->last = !object_parse_records(self->stream, &slot->records);
+    sem_post(&self->full);
+    if (slot->last)
+      return (NULL);
+  }
+}
+
+struct s_pipeline *pipeline_start(stream_t s) {
+  struct s_pipeline *self = calloc(1, sizeof(*self));
+  assert(self != NULL);
+  self->stream = s;
+  sem_init(&self->free, 0, PIPELINE_SLOTS);
+  sem_init(&self->full, 0, 0);
+  atomic_init(&self->stopping, false);
+
+  // signals, the samples of the profiler included, go to the main thread
+  sigset_t all, mask;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &mask);
+  int error = pthread_create(&self->thread, NULL, read_ahead, self);
+  pthread_sigmask(SIG_SETMASK, &mask, NULL);
+  if (error != 0) {
+    sem_destroy(&self->free);
+    sem_destroy(&self->full);
+    free(self);
+    return (NULL);
+  }
+  return (self);
+}
+
+object_t pipeline_next(struct s_pipeline *self) {
+  for (;;) {
+    if (self->slot != NULL && self->at < self->slot->records.count)
+      return object_parse_build(&self->slot->records, &self->at);
+    if (self->slot != NULL) {
+      self->ended = self->slot->last;
+      self->slot = NULL;
+      self->next = (self->next + 1) % PIPELINE_SLOTS;
+      sem_post(&self->free);
+    }
+    if (self->ended)
+      return (NULL);
+    take(&self->full);
+    self->slot = &self->slots[self->next];
+    self->at = 0;
+  }
+}
+
+void pipeline_stop(struct s_pipeline *self) {
+  // the reader thread stops at its next batch, and may wait for a slot
+  atomic_store(&self->stopping, true);
+  sem_post(&self->free);
+  pthread_join(self->thread, NULL);
+
+  for (size_t i = 0; i < PIPELINE_SLOTS; i++)
+    free(self->slots[i].records.data);
+  sem_destroy(&self->free);
+  sem_destroy(&self->full);
+  free(self);
+}
@@ -0,0 +1,28 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include "object.h"
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct s_pipeline;
+
+    // Parses the forms of `s` on a thread of its own, ahead of the calls to
+    // pipeline_next, which build them in order on the calling thread. Nothing
+    // else may read `s` until pipeline_stop. Returns NULL when the thread
+    // cannot be started.
+    struct s_pipeline *pipeline_start(stream_t s);
+    // Next form, or NULL at the end of the input or after a form that could
+    // not be parsed, like object_parse.
+    object_t pipeline_next(struct s_pipeline *self);
+    void pipeline_stop(struct s_pipeline *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIPELINE_H__ */
@@ -0,0 +1,224 @@
+#include "profile.h"
+
+#include <assert.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// Samples are aggregated by the signal handler itself, which cannot allocate:
+// each distinct stack is stored once in `frames` and counted in `stacks`.
+// Stacks deeper than PROFILE_DEPTH keep their innermost frames only.
+#define PROFILE_DEPTH 256
+#define PROFILE_STACKS (1 << 14)
+#define PROFILE_POOL (1 << 20)
+// how many functions the summary lists
+#define PROFILE_TOP 20
+
+object_t volatile profile_frames[PROFILE_FRAMES];
+volatile size_t profile_depth = 0;
+bool profile_running = false;
+
+struct s_stack {
+  uint64_t hash;
+  uint32_t offset;
+  uint16_t depth;
+  bool truncated;
+  size_t count;
+};
+
+static struct s_stack stacks[PROFILE_STACKS];
+static size_t stacks_count = 0;
+static object_t frames[PROFILE_POOL];
+static size_t frames_count = 0;
+// samples that found no room left
+static size_t dropped = 0;
+static size_t samples = 0;
+
+static const char *output = NULL;
+
+static bool stack_equals(const struct s_stack *stack, size_t start,
+                         size_t depth) {
+  for (size_t i = 0; i < depth; i++)
+    if (frames[stack->offset + i] != profile_frames[start + i])
+      return (false);
+  return (true);
+}
+
+static void sample(int signum) {
+  ((void)signum);
+
+  size_t depth = profile_depth;
+  if (depth > PROFILE_FRAMES)
+    depth = PROFILE_FRAMES;
+  bool truncated = depth > PROFILE_DEPTH;
+  size_t start = truncated ? depth - PROFILE_DEPTH : 0;
+  depth -= start;
+
+  uint64_t hash = 14695981039346656037ULL ^ truncated;
+  for (size_t i = 0; i < depth; i++) {
+    hash ^= (uintptr_t)profile_frames[start + i];
+    hash *= 1099511628211ULL;
+  }
+
+  samples += 1;
+  size_t idx = hash & (PROFILE_STACKS - 1);
+  for (;; idx = (idx + 1) & (PROFILE_STACKS - 1)) {
+    struct s_stack *stack = &stacks[idx];
+    if (stack->count == 0) {
+      if (2 * (stacks_count + 1) > PROFILE_STACKS ||
+          frames_count + depth > PROFILE_POOL) {
+        dropped += 1;
+        break;
+      }
+      stack->hash = hash;
+      stack->offset = frames_count;
+      stack->depth = depth;
+      stack->truncated = truncated;
+      for (size_t i = 0; i < depth; i++)
+        frames[frames_count++] = profile_frames[start + i];
+      stack->count = 1;
+      stacks_count += 1;
+      break;
+    }
+    if (stack->hash == hash && stack->depth == depth &&
+        stack->truncated == truncated && stack_equals(stack, start, depth)) {
+      stack->count += 1;
+      break;
+    }
+  }
+}
+
+bool profile_start(const char *path, long interval) {
+  struct sigaction sa = {.sa_handler = sample, .sa_flags = SA_RESTART};
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, NULL) < 0)
+    return (false);
+
+  struct itimerval timer = {
+      .it_interval = {.tv_sec = interval / 1000000,
+                      .tv_usec = interval % 1000000},
+      .it_value = {.tv_sec = interval / 1000000,
+                   .tv_usec = interval % 1000000},
+  };
+  if (setitimer(ITIMER_PROF, &timer, NULL) < 0)
+    return (false);
+  output = path;
+  profile_running = true;
+  return (true);
+}
+
+static const char *frame_name(object_t name) {
+  return name != NULL ? name->symbol.name : "lambda";
+}
+
+// Time spent in each function: `self` when it was the innermost frame of a
+// sample, `total` when it was anywhere in it.
+struct s_entry {
+  object_t name;
+  size_t self;
+  size_t total;
+  // last stack counted in `total`, so that recursion counts once
+  size_t seen;
+};
+
+static int entry_compare(const void *l, const void *r) {
+  const struct s_entry *a = l, *b = r;
+  if (a->self != b->self)
+    return a->self < b->self ? 1 : -1;
+  return (a->total < b->total) - (a->total > b->total);
+}
+
+static struct s_entry *entry_find(struct s_entry *entries, size_t capacity,
+                                  object_t name) {
+  size_t idx = ((uintptr_t)name >> 3) & (capacity - 1);
+  while (entries[idx].total != 0 && entries[idx].name != name)
+    idx = (idx + 1) & (capacity - 1);
+  entries[idx].name = name;
+  return (&entries[idx]);
+}
+
+static void summary(FILE *fp) {
+  size_t capacity = 64;
+  while (capacity < 2 * frames_count + 2)
+    capacity *= 2;
+  struct s_entry *entries = calloc(capacity, sizeof(*entries));
+  assert(entries != NULL);
+
+  size_t toplevel = 0;
+  for (size_t i = 0; i < PROFILE_STACKS; i++) {
+    const struct s_stack *stack = &stacks[i];
+    if (stack->count == 0)
+      continue;
+    if (stack->depth == 0) {
+      toplevel += stack->count;
+      continue;
+    }
+    for (size_t j = 0; j < stack->depth; j++) {
+      struct s_entry *entry =
+          entry_find(entries, capacity, frames[stack->offset + j]);
+      if (entry->seen != i + 1)
+        entry->total += stack->count;
+      entry->seen = i + 1;
+    }
+    entry_find(entries, capacity, frames[stack->offset + stack->depth - 1])
+        ->self += stack->count;
+  }
+
+  size_t count = 0;
+  for (size_t i = 0; i < capacity; i++)
+    if (entries[i].total != 0)
+      entries[count++] = entries[i];
+  qsort(entries, count, sizeof(*entries), entry_compare);
+
+  size_t total = samples > 0 ? samples : 1;
+  fprintf(fp, "%zu samples (%zu dropped), %zu at top level\n", samples,
+          dropped, toplevel);
+  fprintf(fp, "%8s %8s %8s  %s\n", "self%", "total%", "self", "function");
+  for (size_t i = 0; i < count && i < PROFILE_TOP; i++)
+    fprintf(fp, "%7.2f%% %7.2f%% %8zu  %s\n", 100.0 * entries[i].self / total,
+            100.0 * entries[i].total / total, entries[i].self,
+            frame_name(entries[i].name));
+  free(entries);
+}
+
+void profile_stop(void) {
+  if (output == NULL)
+    return;
+
+  struct itimerval timer = {0};
+  setitimer(ITIMER_PROF, &timer, NULL);
+  signal(SIGPROF, SIG_IGN);
+  profile_running = false;
+
+  FILE *fp = fopen(output, "w");
+  if (fp == NULL) {
+    perror(output);
+  } else {
+    for (size_t i = 0; i < PROFILE_STACKS; i++) {
+      const struct s_stack *stack = &stacks[i];
+      if (stack->count == 0)
+        continue;
+      fprintf(fp, "[toplevel]");
+      if (stack->truncated)
+        fprintf(fp, ";[truncated]");
+      for (size_t j = 0; j < stack->depth; j++)
+        fprintf(fp, ";%s", frame_name(frames[stack->offset + j]));
+      fprintf(fp, " %zu\n", stack->count);
+    }
+    fclose(fp);
+  }
+
+  summary(stderr);
+  output = NULL;
+}
+
+void profile_backtrace(FILE *fp) {
+  size_t depth = profile_depth;
+  size_t shown = depth < PROFILE_FRAMES ? depth : PROFILE_FRAMES;
+  for (size_t i = 0; i < shown && i < PROFILE_TOP; i++)
+    fprintf(fp, "  at %s\n", frame_name(profile_frames[shown - 1 - i]));
+  if (depth > PROFILE_TOP)
+    fprintf(fp, "  ... %zu more\n", depth - PROFILE_TOP);
+}
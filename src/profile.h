@@ -0,0 +1,60 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "object.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Lisp functions running, outermost first, kept by the evaluator and the VM
+// while the profiler runs, so that other runs only test a flag per call.
+// Only the first PROFILE_FRAMES frames are recorded, deeper ones are counted.
+#define PROFILE_FRAMES (1 << 18)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // symbol the function of each frame was defined as, NULL for a lambda
+    extern object_t volatile profile_frames[PROFILE_FRAMES];
+    extern volatile size_t profile_depth;
+    extern bool profile_running;
+
+    static inline size_t profile_mark(void)
+    {
+        return profile_depth;
+    }
+
+    static inline void profile_push(object_t func)
+    {
+        if (!profile_running)
+            return;
+        size_t depth = profile_depth;
+        if (depth < PROFILE_FRAMES)
+            profile_frames[depth] = func->function.name;
+        profile_depth = depth + 1;
+    }
+
+    // Drops the frames pushed since `mark` was taken.
+    static inline void profile_unwind(size_t mark)
+    {
+        profile_depth = mark;
+    }
+
+    // Samples the frames every `interval` microseconds of CPU time until
+    // profile_stop, which writes them to `path` as folded stacks, one
+    // "outer;...;inner count" line per distinct stack, and prints the
+    // functions taking the most time.
+    bool profile_start(const char *path, long interval);
+    void profile_stop(void);
+
+    // Prints the innermost frames, known only while the profiler runs.
+    void profile_backtrace(FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PROFILE_H__ */
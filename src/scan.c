@@ -0,0 +1,166 @@
+#include "scan.h"
+
+#include <stddef.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+const uint8_t scan_classes[256] = {
+    [' '] = kCC_space,
+    ['\n'] = kCC_space,
+    ['\r'] = kCC_space,
+    ['\t'] = kCC_space,
+    ['0' ... '9'] = kCC_digit | kCC_symbol,
+    ['a' ... 'z'] = kCC_symbol,
+    ['A' ... 'Z'] = kCC_symbol,
+    ['_'] = kCC_symbol,
+    ['-'] = kCC_symbol,
+    ['+'] = kCC_symbol,
+    ['='] = kCC_symbol,
+    ['!'] = kCC_symbol,
+    ['@'] = kCC_symbol,
+    ['#'] = kCC_symbol,
+    ['$'] = kCC_symbol,
+    ['%'] = kCC_symbol,
+    ['^'] = kCC_symbol,
+    ['&'] = kCC_symbol,
+    ['*'] = kCC_symbol,
+    ['<'] = kCC_symbol,
+    ['>'] = kCC_symbol,
+};
+
+static const char *scalar_space(const char *p, const char *end) {
+  while (p < end && (scan_classes[(unsigned char)*p] & kCC_space) != 0)
+    p++;
+  return (p);
+}
+
+static const char *scalar_symbol(const char *p, const char *end) {
+  while (p < end && (scan_classes[(unsigned char)*p] & kCC_symbol) != 0)
+    p++;
+  return (p);
+}
+
+static const char *scalar_string(const char *p, const char *end) {
+  while (p < end && *p != '"' && *p != '\\')
+    p++;
+  return (p);
+}
+
+#if defined(__x86_64__)
+
+// The vector scans test a whole register of characters at once and fall back
+// to the scalar ones for the tail. SSE2 is part of x86-64; AVX2 is used when
+// the CPU has it. Each mask has one bit per character that belongs to the
+// run, so the run stops at the first zero bit. The helpers are inlined even
+// in unoptimized builds, where a call per register would cost more than the
+// scalar loop saves.
+#define SCAN_INLINE static __attribute__((always_inline)) inline
+
+#define SCANNERS(_isa, _width, _vec, _load, _set1, _or, _eq, _sub, _min,       \
+                 _movemask)                                                    \
+  SCAN_INLINE _vec _isa##_range(_vec v, char lo, char hi) {                    \
+    _vec d = _sub(v, _set1(lo));                                               \
+    return _eq(_min(d, _set1(hi - lo)), d);                                    \
+  }                                                                            \
+                                                                               \
+  SCAN_INLINE _vec _isa##_is_space(_vec v) {                                   \
+    return _or(_or(_eq(v, _set1(' ')), _eq(v, _set1('\n'))),                   \
+               _or(_eq(v, _set1('\r')), _eq(v, _set1('\t'))));                 \
+  }                                                                            \
+                                                                               \
+  SCAN_INLINE _vec _isa##_is_symbol(_vec v) {                                  \
+    _vec alpha = _isa##_range(_or(v, _set1(0x20)), 'a', 'z');                  \
+    _vec digit = _isa##_range(v, '0', '9');                                    \
+    /* "!#$%&*+-<=>@^_" */                                                     \
+    _vec punct = _or(_or(_eq(v, _set1('!')), _isa##_range(v, '#', '&')),       \
+                     _or(_isa##_range(v, '*', '+'), _eq(v, _set1('-'))));      \
+    punct = _or(punct, _or(_isa##_range(v, '<', '>'), _eq(v, _set1('@'))));    \
+    punct = _or(punct, _isa##_range(v, '^', '_'));                             \
+    return _or(_or(alpha, digit), punct);                                      \
+  }                                                                            \
+                                                                               \
+  SCAN_INLINE _vec _isa##_is_plain(_vec v) {                                   \
+    return _eq(_or(_eq(v, _set1('"')), _eq(v, _set1('\\'))), _set1(0));        \
+  }                                                                            \
+                                                                               \
+  SCAN_INLINE const char *_isa##_scan(const char *p, const char *end,          \
+                                      _vec (*run)(_vec)) {                     \
+    for (; end - p >= _width; p += _width) {                                   \
+      uint32_t mask = ~(uint32_t)_movemask(run(_load((const _vec *)p)));       \
+      if (_width < 32)                                                         \
+        mask &= (1u << (_width % 32)) - 1;                                     \
+      if (mask != 0)                                                           \
+        return (p + __builtin_ctz(mask));                                      \
+    }                                                                          \
+    return (p);                                                                \
+  }                                                                            \
+                                                                               \
+  static const char *_isa##_space(const char *p, const char *end) {            \
+    return scalar_space(_isa##_scan(p, end, _isa##_is_space), end);            \
+  }                                                                            \
+                                                                               \
+  static const char *_isa##_symbol(const char *p, const char *end) {           \
+    return scalar_symbol(_isa##_scan(p, end, _isa##_is_symbol), end);          \
+  }                                                                            \
+                                                                               \
+  static const char *_isa##_string(const char *p, const char *end) {           \
+    return scalar_string(_isa##_scan(p, end, _isa##_is_plain), end);           \
+  }
+
+SCANNERS(sse2, 16, __m128i, _mm_loadu_si128, _mm_set1_epi8, _mm_or_si128,
+         _mm_cmpeq_epi8, _mm_sub_epi8, _mm_min_epu8, _mm_movemask_epi8)
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+SCANNERS(avx2, 32, __m256i, _mm256_loadu_si256, _mm256_set1_epi8,
+         _mm256_or_si256, _mm256_cmpeq_epi8, _mm256_sub_epi8, _mm256_min_epu8,
+         _mm256_movemask_epi8)
+#pragma GCC pop_options
+
+#endif
+
+static struct {
+  const char *(*space)(const char *, const char *);
+  const char *(*symbol)(const char *, const char *);
+  const char *(*string)(const char *, const char *);
+} scanners = {scalar_space, scalar_symbol, scalar_string};
+
+__attribute__((constructor)) static void scan_init(void) {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    scanners.space = avx2_space;
+    scanners.symbol = avx2_symbol;
+    scanners.string = avx2_string;
+  } else {
+    scanners.space = sse2_space;
+    scanners.symbol = sse2_symbol;
+    scanners.string = sse2_string;
+  }
+#endif
+}
+
+// Most blanks and tokens are short: their first SCAN_SHORT characters are
+// tested one by one, and only longer runs go through the vector scans.
+#define SCAN_SHORT 16
+
+#define SCAN(_run)                                                             \
+  do {                                                                         \
+    const char *stop = end - p > SCAN_SHORT ? p + SCAN_SHORT : end;            \
+    p = scalar_##_run(p, stop);                                                \
+    return p < stop || p == end ? p : scanners._run(p, end);                   \
+  } while (0)
+
+const char *scan_space(const char *p, const char *end) { //
+  SCAN(space);
+}
+
+const char *scan_symbol(const char *p, const char *end) { //
+  SCAN(symbol);
+}
+
+const char *scan_string(const char *p, const char *end) { //
+  SCAN(string);
+}
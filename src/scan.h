@@ -0,0 +1,38 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Character classes of the reader.
+typedef enum
+{
+    kCC_space = 1 << 0,  // " \n\r\t"
+    kCC_digit = 1 << 1,  // "0-9"
+    kCC_symbol = 1 << 2, // letters, digits and "_-+=!@#$%^&*<>"
+} char_class_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    extern const uint8_t scan_classes[256];
+
+    static inline bool scan_is(int c, char_class_t mask)
+    {
+        return c != EOF && (scan_classes[(unsigned char)c] & mask) != 0;
+    }
+
+    // Each scan returns the first character in [p, end) that stops it, or end.
+    const char *scan_space(const char *p, const char *end);
+    const char *scan_symbol(const char *p, const char *end);
+    // stops at '"' and '\\'
+    const char *scan_string(const char *p, const char *end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCAN_H__ */
@@ -0,0 +1,141 @@
+#include "server.h"
+#include "object_parse.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SERVER_BACKLOG 128
+#define SERVER_WORKERS_MAX 256
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int signum) {
+  ((void)signum);
+  stopping = 1;
+}
+
+// Evaluates the forms of one connection in the global frame, so definitions
+// made by a client stay visible to the next clients of the same worker.
+static void serve(object_t env, int fd) {
+  // results and the output of `print` both go to the client
+  fflush(stdout);
+  int out = dup(STDOUT_FILENO);
+  dup2(fd, STDOUT_FILENO);
+
+  stream_new(s, stream_create_from_socket(fd), {
+    bool running = true;
+    while (running) {
+      running = false;
+      object_new(object, object_parse(s), {
+        running = true;
+        object_new(result, object_run(env, object), {
+          object_print(result);
+          printf("\n");
+          fflush(stdout);
+        });
+      });
+    }
+  });
+
+  fflush(stdout);
+  dup2(out, STDOUT_FILENO);
+  close(out);
+}
+
+static void work(object_t env, int listener) {
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  // a client going away must not kill the worker answering it
+  signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      perror("accept");
+      exit(1);
+    }
+    serve(env, fd);
+    close(fd);
+  }
+}
+
+static pid_t spawn(object_t env, int listener) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    work(env, listener);
+    exit(0);
+  }
+  if (pid < 0)
+    perror("fork");
+  return (pid);
+}
+
+int server_run(object_t env, const char *path, size_t workers) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    printf("ERROR: socket path too long '%s'\n", path);
+    return (1);
+  }
+  strcpy(addr.sun_path, path);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    perror("socket");
+    return (1);
+  }
+  unlink(path);
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listener, SERVER_BACKLOG) < 0) {
+    perror(path);
+    close(listener);
+    return (1);
+  }
+
+  struct sigaction sa = {.sa_handler = stop};
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  if (workers == 0)
+    workers = 1;
+  if (workers > SERVER_WORKERS_MAX)
+    workers = SERVER_WORKERS_MAX;
+
+  // a worker that dies, on a form it could not evaluate, is replaced
+  pid_t pids[SERVER_WORKERS_MAX] = {0};
+  for (size_t i = 0; i < workers; i++)
+    pids[i] = spawn(env, listener);
+
+  while (!stopping) {
+    pid_t pid = wait(NULL);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (size_t i = 0; i < workers && !stopping; i++)
+      if (pids[i] == pid)
+        pids[i] = spawn(env, listener);
+  }
+
+  for (size_t i = 0; i < workers; i++)
+    if (pids[i] > 0)
+      kill(pids[i], SIGTERM);
+  while (wait(NULL) > 0 || errno == EINTR)
+    ;
+
+  close(listener);
+  unlink(path);
+  return (0);
+}
@@ -0,0 +1,24 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "object.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Serves the UNIX socket `path` with `workers` processes forked from
+    // this one, which share the heap of `env` copy-on-write. Each connection
+    // sends forms until it shuts down its side; each result is written back
+    // printed, one per line. Returns once SIGINT or SIGTERM is received, with
+    // the exit status of the process.
+    int server_run(object_t env, const char *path, size_t workers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SERVER_H__ */
@@ -1,29 +1,50 @@
 #include "stream.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Pipes, terminals and anything that cannot be mapped are read by blocks of
+// this size; a read returns as soon as some input is available, so that the
+// REPL still answers line by line.
+#define STREAM_BLOCK (64 * 1024)
 
 typedef enum {
   kST_file = 0xB00B,
   kST_string = 0xCAFE,
+  kST_map = 0xBEEF,
 } stream_type_t;
 
 typedef struct {
-  size_t idx;
+  int fd;
+  char *buffer;
+} FILE_;
+
+typedef struct {
   char *str;
 } STRING;
 
+typedef struct {
+  void *addr;
+  size_t size;
+} MAP;
+
 struct s_stream_private {
-  int (*next)(stream_t);
-  int (*peek)(stream_t);
+  const char *cur;
+  const char *end;
+  bool (*fill)(stream_t);
 
   stream_type_t type;
   union {
-    FILE *file;
+    FILE_ file;
     STRING string;
+    MAP map;
   };
 };
 
@@ -37,37 +58,27 @@ static struct s_stream_private *as(stream_t ptr, stream_type_t type) {
 
 #define as_file(ptr) (as(ptr, kST_file)->file)
 
-static int next_file(stream_t ptr) { //
-  return getc(as_file(ptr));
-}
-
-static int peek_file(stream_t ptr) {
-  int ch = next_file(ptr);
-  if (ch != EOF) {
-    int err = ungetc(ch, as_file(ptr));
-    assert(err != EOF);
-    ((void)err);
-  }
-  return ch;
-}
-
-#define as_string(ptr) (as(ptr, kST_string)->string)
-
-static int peek_string(stream_t ptr) {
-  char ch = as_string(ptr).str[as_string(ptr).idx];
-  return ch == 0 ? EOF : ch;
+static bool fill_file(stream_t ptr) {
+  ssize_t size = 0;
+  do {
+    size = read(as_file(ptr).fd, as_file(ptr).buffer, STREAM_BLOCK);
+  } while (size < 0 && errno == EINTR);
+  if (size <= 0)
+    return (false);
+  ptr->cur = as_file(ptr).buffer;
+  ptr->end = as_file(ptr).buffer + size;
+  return (true);
 }
 
-static int next_string(stream_t ptr) {
-  char ch = peek_string(ptr);
-  if (ch != EOF)
-    as_string(ptr).idx += 1;
-  return ch;
+// Strings and mapped files are a single block: there is nothing to refill.
+static bool fill_none(stream_t ptr) {
+  ((void)ptr);
+  return (false);
 }
 
 stream_t stream_skip(stream_t stream, const char *string) {
-  while (strchr(string, stream->peek(stream)) != NULL) {
-    stream->next(stream);
+  while (strchr(string, stream_peek(stream)) != NULL) {
+    stream->cur += 1;
   }
   return stream;
 }
@@ -78,12 +89,17 @@ static void stream_destroy(void *ptr) {
 
   switch (private(self)->type) {
   case kST_file: {
+    free(private(self)->file.buffer);
     break;
   }
   case kST_string: {
     free(private(self)->string.str);
     break;
   }
+  case kST_map: {
+    munmap(private(self)->map.addr, private(self)->map.size);
+    break;
+  }
   default: {
     assert(false);
     break;
@@ -91,23 +107,38 @@ static void stream_destroy(void *ptr) {
   }
 }
 
+__attribute__((constructor)) static void stream_init(void) {
+  memory_set_destructor(STREAM_KIND, stream_destroy);
+}
+
 static stream_t stream_create(stream_type_t type, ...) {
-  struct s_stream_private *self = memory_create(sizeof(*self), stream_destroy);
+  struct s_stream_private *self =
+      memory_create_kind(sizeof(*self), STREAM_KIND);
   va_list ap;
 
   va_start(ap, type);
   switch (self->type = type) {
   case kST_file: {
-    self->file = va_arg(ap, typeof(self->file));
-    self->next = next_file;
-    self->peek = peek_file;
+    self->file.fd = va_arg(ap, typeof(self->file.fd));
+    self->file.buffer = malloc(STREAM_BLOCK);
+    assert(self->file.buffer != NULL);
+    self->cur = self->end = self->file.buffer;
+    self->fill = fill_file;
     break;
   }
   case kST_string: {
     self->string.str = strdup(va_arg(ap, typeof(self->string.str)));
-    self->string.idx = 0;
-    self->next = next_string;
-    self->peek = peek_string;
+    self->cur = self->string.str;
+    self->end = self->string.str + strlen(self->string.str);
+    self->fill = fill_none;
+    break;
+  }
+  case kST_map: {
+    self->map.addr = va_arg(ap, typeof(self->map.addr));
+    self->map.size = va_arg(ap, typeof(self->map.size));
+    self->cur = self->map.addr;
+    self->end = self->cur + self->map.size;
+    self->fill = fill_none;
     break;
   }
   default: {
@@ -120,8 +151,32 @@ static stream_t stream_create(stream_type_t type, ...) {
   return ((stream_t)self);
 }
 
+// Regular files are mapped whole; everything else is read by blocks. The
+// stream reads the descriptor of `file` directly, so the caller must not read
+// from `file` itself meanwhile.
 stream_t stream_create_from_file(FILE *file) {
-  return stream_create(kST_file, file);
+  int fd = fileno(file);
+  struct stat st;
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (offset >= 0 && offset <= st.st_size && addr != MAP_FAILED) {
+      madvise(addr, st.st_size, MADV_SEQUENTIAL);
+      stream_t self = stream_create(kST_map, addr, (size_t)st.st_size);
+      self->cur += offset;
+      return (self);
+    }
+    if (addr != MAP_FAILED)
+      munmap(addr, st.st_size);
+  }
+  return stream_create(kST_file, fd);
+}
+
+// Sockets are read by blocks, as soon as some input arrives; the descriptor
+// stays open when the stream is deleted.
+stream_t stream_create_from_socket(int fd) {
+  return stream_create(kST_file, fd);
 }
 
 stream_t stream_create_from_string(const char *str) {
@@ -3,14 +3,21 @@
 
 #include "memory.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 
+// memory kind of the streams, clear of the object types
+#define STREAM_KIND (MEMORY_KINDS - 1)
+
 typedef struct s_stream *stream_t;
 
 struct s_stream
 {
-  int (*next)(stream_t);
-  int (*peek)(stream_t);
+  // characters of the current block not read yet
+  const char *cur;
+  const char *end;
+  // loads the next block once `cur` reaches `end`, false at end of input
+  bool (*fill)(stream_t);
 };
 
 #ifdef __cplusplus
@@ -18,7 +25,23 @@ extern "C"
 {
 #endif
 
+  static inline int stream_peek(stream_t self)
+  {
+    if (self->cur == self->end && self->fill(self) == false)
+      return EOF;
+    return (unsigned char)*self->cur;
+  }
+
+  static inline int stream_next(stream_t self)
+  {
+    int ch = stream_peek(self);
+    if (ch != EOF)
+      self->cur += 1;
+    return ch;
+  }
+
   stream_t stream_create_from_file(FILE *fp);
+  stream_t stream_create_from_socket(int fd);
   stream_t stream_create_from_string(const char *str);
 
   stream_t stream_skip(stream_t stream, const char *string);
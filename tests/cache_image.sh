@@ -0,0 +1,32 @@
+#!/bin/sh
+# A script run with --cache on top of an --image must give the same output
+# cold, when it writes its cache, and warm, when it loads it: the symbols of
+# the cache and of the image are the same.
+set -e
+
+CLISP=${CLISP:-./clisp.exe}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+cat > "$DIR/prelude.lisp" <<'LISP'
+(defun square (x) (* x x))
+(define base 7)
+LISP
+cat > "$DIR/script.lisp" <<'LISP'
+(print (square base))
+(print (quote (square base print)))
+(defun twice (f x) (f (f x)))
+(print (twice square 3))
+LISP
+expected='49(square base print)81'
+
+"$CLISP" --dump-image "$DIR/prelude.img" "$DIR/prelude.lisp" > /dev/null
+for run in cold warm; do
+  output=$("$CLISP" --cache --image "$DIR/prelude.img" "$DIR/script.lisp")
+  if [ "$output" != "$expected" ]; then
+    echo "FAIL: $run run printed '$output', expected '$expected'"
+    exit 1
+  fi
+done
+[ -f "$DIR/script.lisp.fasl" ] || { echo "FAIL: no cache written"; exit 1; }
+echo "OK: --cache with --image"
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Errors unwind the C frames of the evaluators: the references they held must
+# be released, so that only the symbols, which are immortal, are left alive at
+# the end, with both evaluators.
+set -e
+
+CLISP=${CLISP:-./clisp.exe}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+cat > "$DIR/errors.lisp" <<'LISP'
+(defun deep (n) (+ 1 (deep (+ n 1))))
+(deep 0)
+(defun bad (n) (let (x (+ n 1)) (+ x (undefined x))))
+(bad 1)
+(defun pair (a b) (+ a b))
+(pair 1 (undefined))
+(eval (quote (+ 1 (undefined))))
+(do 1 (undefined) 2)
+LISP
+
+for evaluator in bytecode tree-walk; do
+  flag=
+  [ "$evaluator" = tree-walk ] && flag=--tree-walk
+  live=$("$CLISP" $flag --memory-stats "$DIR/errors.lisp" 2>&1 > /dev/null |
+    awk 'NR > 1 && $1 == "refs" { exit } NR > 1 && $1 != "symbol" && $4 != 0')
+  if [ -n "$live" ]; then
+    echo "FAIL: objects left alive after errors with the $evaluator evaluator:"
+    echo "$live"
+    exit 1
+  fi
+done
+echo "OK: errors release what they unwind"
@@ -0,0 +1,30 @@
+#!/bin/sh
+# A script run with --pipeline is parsed ahead by a reader thread: it must
+# print the same as when each form is parsed before it runs, over several
+# batches of the reader thread and up to a form that is not terminated.
+set -e
+
+CLISP=${CLISP:-./clisp.exe}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+awk 'BEGIN {
+  for (i = 0; i < 20000; i++)
+    printf "(define v%d (quote (%d -%d \"s\\t%d\" sym-%d)))\n", i, i, i, i, i
+  print "(print v0)"
+  print "(print v19999)"
+  print "(print (read \"(1 \\\"x\\\" y)\"))"
+  print "(print (quote (a (b \"c\\n\" -1) (quote d))))"
+  print "(print (quote (e (f"
+}' > "$DIR/script.lisp"
+
+"$CLISP" "$DIR/script.lisp" > "$DIR/expected"
+"$CLISP" --pipeline "$DIR/script.lisp" > "$DIR/file"
+"$CLISP" --pipeline /dev/stdin < "$DIR/script.lisp" > "$DIR/stdin"
+if ! cmp -s "$DIR/expected" "$DIR/file" ||
+   ! cmp -s "$DIR/expected" "$DIR/stdin"; then
+  echo "FAIL: --pipeline does not print what the script prints"
+  diff "$DIR/expected" "$DIR/file" | head -5
+  exit 1
+fi
+echo "OK: --pipeline runs a script as it is parsed"
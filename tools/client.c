@@ -0,0 +1,57 @@
+// Sends a script, or the standard input, to a server started with
+// `clisp.exe --server SOCKET`, then prints the results it writes back.
+//
+//   ./tools/client.exe SOCKET [FILE]
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int copy(int from, int to) {
+  char buffer[64 * 1024];
+  ssize_t size = 0;
+
+  while ((size = read(from, buffer, sizeof(buffer))) > 0) {
+    for (ssize_t done = 0, n = 0; done < size; done += n) {
+      n = write(to, buffer + done, size - done);
+      if (n < 0)
+        return (-1);
+    }
+  }
+  return (size < 0 ? -1 : 0);
+}
+
+int main(int argc, const char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    printf("usage: %s SOCKET [FILE]\n", argv[0]);
+    return (1);
+  }
+
+  FILE *fp = argc == 3 ? fopen(argv[2], "r") : stdin;
+  if (fp == NULL) {
+    perror(argv[2]);
+    return (1);
+  }
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror(argv[1]);
+    return (1);
+  }
+
+  // the server answers once it has read everything
+  if (copy(fileno(fp), fd) < 0 || shutdown(fd, SHUT_WR) < 0 ||
+      copy(fd, STDOUT_FILENO) < 0) {
+    perror(argv[1]);
+    return (1);
+  }
+
+  close(fd);
+  if (fp != stdin)
+    fclose(fp);
+  return (0);
+}
@@ -0,0 +1,114 @@
+// Load generator for `clisp.exe --server SOCKET`: each of CONNECTIONS threads
+// sends FORM over a new connection REQUESTS times in a row, and waits for the
+// answer. Prints the throughput and the latency percentiles.
+//
+//   ./tools/load.exe SOCKET FORM [CONNECTIONS [REQUESTS]]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+struct s_client {
+  pthread_t thread;
+  const struct sockaddr_un *addr;
+  const char *form;
+  size_t requests;
+  // latency of each request, in nanoseconds
+  long *latencies;
+  size_t failures;
+};
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000000L + ts.tv_nsec);
+}
+
+static int request(const struct sockaddr_un *addr, const char *form) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return (-1);
+
+  int status = -1;
+  size_t size = strlen(form);
+  if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == 0 &&
+      write(fd, form, size) == (ssize_t)size && shutdown(fd, SHUT_WR) == 0) {
+    char buffer[4096];
+    ssize_t n = 0;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+      ;
+    status = n == 0 ? 0 : -1;
+  }
+  close(fd);
+  return (status);
+}
+
+static void *run(void *ptr) {
+  struct s_client *self = ptr;
+
+  for (size_t i = 0; i < self->requests; i++) {
+    long start = now();
+    if (request(self->addr, self->form) < 0)
+      self->failures += 1;
+    self->latencies[i] = now() - start;
+  }
+  return (NULL);
+}
+
+static int compare(const void *l, const void *r) {
+  long a = *(const long *)l, b = *(const long *)r;
+  return (a > b) - (a < b);
+}
+
+int main(int argc, const char *argv[]) {
+  if (argc < 3 || argc > 5) {
+    printf("usage: %s SOCKET FORM [CONNECTIONS [REQUESTS]]\n", argv[0]);
+    return (1);
+  }
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+  size_t connections = argc > 3 ? strtoul(argv[3], NULL, 10) : 8;
+  size_t requests = argc > 4 ? strtoul(argv[4], NULL, 10) : 1000;
+  if (connections == 0 || requests == 0)
+    return (1);
+
+  struct s_client *clients = calloc(connections, sizeof(*clients));
+  long *latencies = calloc(connections * requests, sizeof(*latencies));
+  if (clients == NULL || latencies == NULL)
+    return (1);
+
+  long start = now();
+  for (size_t i = 0; i < connections; i++) {
+    clients[i].addr = &addr;
+    clients[i].form = argv[2];
+    clients[i].requests = requests;
+    clients[i].latencies = latencies + i * requests;
+    pthread_create(&clients[i].thread, NULL, run, &clients[i]);
+  }
+
+  size_t failures = 0;
+  for (size_t i = 0; i < connections; i++) {
+    pthread_join(clients[i].thread, NULL);
+    failures += clients[i].failures;
+  }
+  double elapsed = (now() - start) / 1e9;
+
+  size_t total = connections * requests;
+  qsort(latencies, total, sizeof(*latencies), compare);
+  printf("requests: %zu (%zu failed)\n", total, failures);
+  printf("elapsed: %.3f s\n", elapsed);
+  printf("throughput: %.0f req/s\n", total / elapsed);
+  printf("latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+         latencies[total / 2] / 1e3, latencies[total * 99 / 100] / 1e3,
+         latencies[total - 1] / 1e3);
+
+  free(latencies);
+  free(clients);
+  return (failures == 0 ? 0 : 1);
+}